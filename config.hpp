@@ -2,7 +2,9 @@
 #define _CONFIG_HPP_
 
 // GSC MODULES
+#define COMPILE_BANS 1
 #define COMPILE_BOTS 1
+#define COMPILE_CHATFILTER 1
 #define COMPILE_ENTITY 1
 #define COMPILE_EXEC 1
 #define COMPILE_LEVEL 1
@@ -19,6 +21,9 @@
 // RATE LIMITER
 #define COMPILE_RATELIMITER 1
 
+// HTTP SERVER
+#define COMPILE_HTTPSERVER 1
+
 // EXTRA STUFF
 #ifdef EXTRA_CONFIG_INC
 #include "extra/config.hpp"
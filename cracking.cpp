@@ -1,31 +1,419 @@
 #include "cracking.hpp"
 
-void cracking_hook_function(int from, int to)
+#define TRAMPOLINE_SIZE 32
+#define TRAMPOLINE_POOL_SIZE 4096
+
+#include <cxxabi.h>
+
+static hook_profile_t hook_profiles[MAX_HOOK_PROFILES];
+static int hook_profiles_count = 0;
+
+hook_profile_t *cracking_profile_entry(int to)
+{
+	static hook_profile_t overflow;
+
+	for (int i = 0; i < hook_profiles_count; i++)
+	{
+		if (hook_profiles[i].to == to)
+		{
+			hook_profiles[i].instrumented = true;
+			return &hook_profiles[i];
+		}
+	}
+
+	if (hook_profiles_count == MAX_HOOK_PROFILES)
+		return &overflow;
+
+	hook_profile_t *entry = &hook_profiles[hook_profiles_count++];
+
+	memset(entry, 0, sizeof(hook_profile_t));
+	entry->to = to;
+	entry->instrumented = true;
+
+	return entry;
+}
+
+static void cracking_profile_register(int from, int to, int type)
+{
+	for (int i = 0; i < hook_profiles_count; i++)
+	{
+		if (hook_profiles[i].to == to)
+		{
+			hook_profiles[i].sites++;
+			return;
+		}
+	}
+
+	if (hook_profiles_count == MAX_HOOK_PROFILES)
+		return;
+
+	hook_profile_t *entry = &hook_profiles[hook_profiles_count++];
+
+	memset(entry, 0, sizeof(hook_profile_t));
+	entry->to = to;
+	entry->from = from;
+	entry->sites = 1;
+	entry->type = type;
+}
+
+// Entries stay in place, HOOK_PROFILE keeps pointers to them. One without sites and
+// without instrumentation is left out of the dump.
+static void cracking_profile_unregister(int to)
+{
+	for (int i = 0; i < hook_profiles_count; i++)
+	{
+		if (hook_profiles[i].to == to && hook_profiles[i].sites > 0)
+		{
+			hook_profiles[i].sites--;
+			return;
+		}
+	}
+}
+
+static void cracking_write_jump(int from, int to)
 {
 	int relative = to - (from+5); // +5 is the position of next opcode
 	memset((void *)from, 0xE9, 1); // JMP-OPCODE
 	memcpy((void *)(from+1), &relative, 4); // set relative address with endian
 }
 
+void cracking_hook_function(int from, int to)
+{
+	cracking_profile_register(from, to, HOOK_TYPE_FUNCTION);
+	cracking_write_jump(from, to);
+}
+
 void cracking_hook_call(int from, int to)
 {
+	cracking_profile_register(from, to, HOOK_TYPE_CALL);
+
 	int relative = to - (from+5); // +5 is the position of next opcode
 	memcpy((void *)(from+1), &relative, 4); // set relative address with endian
 }
 
+static int cracking_profile_compare(const void *a, const void *b)
+{
+	const hook_profile_t *pa = *(const hook_profile_t **)a;
+	const hook_profile_t *pb = *(const hook_profile_t **)b;
+
+	if (pa->cycles == pb->cycles)
+		return 0;
+
+	return pa->cycles < pb->cycles ? 1 : -1;
+}
+
+// hook_profile [reset]
+void cracking_profile_dump()
+{
+	if (Cmd_Argc() > 1 && strcmp(Cmd_Argv(1), "reset") == 0)
+	{
+		for (int i = 0; i < hook_profiles_count; i++)
+		{
+			hook_profiles[i].calls = 0;
+			hook_profiles[i].cycles = 0;
+		}
+
+		Com_Printf("hook_profile: counters reset\n");
+		return;
+	}
+
+	const char *types[] = { "call", "function", "cHook" };
+	hook_profile_t *sorted[MAX_HOOK_PROFILES];
+
+	for (int i = 0; i < hook_profiles_count; i++)
+		sorted[i] = &hook_profiles[i];
+
+	qsort(sorted, hook_profiles_count, sizeof(hook_profile_t *), cracking_profile_compare);
+
+	if (!sv_hookProfile->boolean)
+		Com_Printf("hook_profile: sv_hookProfile is disabled, counters are not updated\n");
+
+	Com_Printf("%-40s %-8s %-10s %5s %10s %14s %10s\n", "handler", "type", "site", "sites", "calls", "cycles", "per call");
+
+	for (int i = 0; i < hook_profiles_count; i++)
+	{
+		hook_profile_t *entry = sorted[i];
+		char name[64];
+		Dl_info info;
+
+		if (entry->sites == 0 && !entry->instrumented)
+			continue;
+
+		if (dladdr((void *)entry->to, &info) && info.dli_sname != NULL)
+		{
+			int status;
+			char *demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+
+			snprintf(name, sizeof(name), "%s", status == 0 ? demangled : info.dli_sname);
+			free(demangled);
+
+			char *args = strchr(name, '(');
+
+			if (args != NULL)
+				*args = '\0';
+		}
+		else
+			snprintf(name, sizeof(name), "0x%08X", entry->to);
+
+		if (!entry->instrumented)
+		{
+			Com_Printf("%-40s %-8s 0x%08X %5d %10s %14s %10s\n", name, types[entry->type], entry->from, entry->sites, "-", "-", "-");
+			continue;
+		}
+
+		Com_Printf("%-40s %-8s 0x%08X %5d %10u %14llu %10llu\n", name, types[entry->type], entry->from, entry->sites,
+		           entry->calls, entry->cycles, entry->calls ? entry->cycles / entry->calls : 0);
+	}
+}
+
+// Length of a ModRM operand including SIB byte and displacement
+static int cracking_modrm_length(unsigned char *code)
+{
+	int mod = code[0] >> 6;
+	int rm = code[0] & 7;
+	int length = 1;
+
+	if (mod != 3 && rm == 4)
+	{
+		length++; // SIB
+
+		if (mod == 0 && (code[1] & 7) == 5)
+			length += 4;
+	}
+
+	if (mod == 0 && rm == 5)
+		length += 4;
+	else if (mod == 1)
+		length += 1;
+	else if (mod == 2)
+		length += 4;
+
+	return length;
+}
+
+// Only position independent instructions that show up in gcc prologues,
+// anything else (relative jumps/calls, unknown opcodes) returns 0
+static int cracking_instruction_length(unsigned char *code)
+{
+	unsigned char op = code[0];
+
+	if (op >= 0x50 && op <= 0x5F) // push/pop reg
+		return 1;
+
+	if (op >= 0xB8 && op <= 0xBF) // mov reg, imm32
+		return 5;
+
+	switch (op)
+	{
+	case 0x90: // nop
+		return 1;
+
+	case 0x6A: // push imm8
+		return 2;
+
+	case 0x68: // push imm32
+		return 5;
+
+	case 0x01: case 0x03: // add
+	case 0x29: case 0x2B: // sub
+	case 0x31: case 0x33: // xor
+	case 0x39: case 0x3B: // cmp
+	case 0x85: // test
+	case 0x89: case 0x8B: // mov
+	case 0x8D: // lea
+		return 1 + cracking_modrm_length(code + 1);
+
+	case 0x83: // arith r/m, imm8
+	case 0xC6: // mov r/m8, imm8
+		return 1 + cracking_modrm_length(code + 1) + 1;
+
+	case 0x81: // arith r/m, imm32
+	case 0xC7: // mov r/m, imm32
+		return 1 + cracking_modrm_length(code + 1) + 4;
+
+	case 0x0F:
+		if (code[1] == 0xB6 || code[1] == 0xB7 || code[1] == 0xBE || code[1] == 0xBF) // movzx/movsx
+			return 2 + cracking_modrm_length(code + 2);
+		return 0;
+	}
+
+	return 0;
+}
+
+static int cracking_allocate_trampoline()
+{
+	static unsigned char *pool = NULL;
+	static int used = 0;
+
+	if (pool == NULL)
+	{
+		void *mem = mmap(NULL, TRAMPOLINE_POOL_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (mem == MAP_FAILED)
+			return 0;
+
+		pool = (unsigned char *)mem;
+	}
+
+	if (used + TRAMPOLINE_SIZE > TRAMPOLINE_POOL_SIZE)
+		return 0;
+
+	int trampoline = (int)(pool + used);
+	used += TRAMPOLINE_SIZE;
+
+	return trampoline;
+}
+
+// Copies the instructions overwritten by the jump into a trampoline that
+// continues in the original function, so the original can be called while hooked
+static int cracking_build_trampoline(int from)
+{
+	int length = 0;
+
+	while (length < 5)
+	{
+		int instruction = cracking_instruction_length((unsigned char *)(from + length));
+
+		if (!instruction)
+			return 0;
+
+		length += instruction;
+	}
+
+	if (length > TRAMPOLINE_SIZE - 5)
+		return 0;
+
+	int trampoline = cracking_allocate_trampoline();
+
+	if (!trampoline)
+		return 0;
+
+	memcpy((void *)trampoline, (void *)from, length);
+	cracking_write_jump(trampoline + length, from + length);
+
+	return trampoline;
+}
+
 cHook::cHook(int from, int to)
 {
 	this->from = from;
 	this->to = to;
+	this->trampoline = cracking_build_trampoline(from);
+
+	cracking_profile_register(from, to, HOOK_TYPE_CHOOK);
+
+	if (!this->trampoline)
+		printf("> [WARNING] cHook: could not relocate prologue at 0x%08X, falling back to unhook/rehook\n", from);
+}
+
+cHook::~cHook()
+{
+	cracking_profile_unregister(to);
 }
 
 void cHook::hook()
 {
 	memcpy((void *)oldCode, (void *)from, 5);
-	cracking_hook_function(from, to);
+	cracking_write_jump(from, to);
 }
 
 void cHook::unhook()
 {
 	memcpy((void *)from, (void *)oldCode, 5);
 }
+
+// Address to call the original function through, pair with rehook() after the call
+int cHook::original()
+{
+	if (trampoline)
+		return trampoline;
+
+	unhook();
+	return from;
+}
+
+void cHook::rehook()
+{
+	if (!trampoline)
+		hook();
+}
+
+// Per-call overhead of a hooked function, calling the original via unhook/rehook versus the trampoline
+#define BENCHMARK_CALLS 100000
+
+static cHook *benchmark_hook = NULL;
+
+static int benchmark_unhook(int value)
+{
+	benchmark_hook->unhook();
+
+	int (*sig)(int value);
+	*(int *)&sig = benchmark_hook->from;
+
+	int ret = sig(value);
+
+	benchmark_hook->hook();
+
+	return ret;
+}
+
+static int benchmark_trampoline(int value)
+{
+	int (*sig)(int value);
+	*(int *)&sig = benchmark_hook->trampoline;
+
+	return sig(value);
+}
+
+static unsigned long long benchmark_run(int target)
+{
+	int (* volatile sig)(int value);
+	*(int *)&sig = target;
+
+	unsigned long long start = cracking_rdtsc();
+
+	for (int i = 0; i < BENCHMARK_CALLS; i++)
+		sig(i);
+
+	return cracking_rdtsc() - start;
+}
+
+void cracking_benchmark_hooks()
+{
+	static int target = 0;
+
+	if (!target)
+	{
+		// push ebp; mov ebp, esp; mov eax, [ebp+8]; pop ebp; ret
+		unsigned char identity[] = { 0x55, 0x89, 0xE5, 0x8B, 0x45, 0x08, 0x5D, 0xC3 };
+		void *mem = mmap(NULL, sizeof(identity), PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (mem == MAP_FAILED)
+		{
+			Com_Printf("hook_benchmark: could not allocate target function\n");
+			return;
+		}
+
+		memcpy(mem, identity, sizeof(identity));
+		target = (int)mem;
+		benchmark_hook = new cHook(target, (int)benchmark_unhook);
+
+		// Its handler changes per run and the target is not engine code, keep it out of hook_profile
+		cracking_profile_unregister(benchmark_hook->to);
+	}
+
+	unsigned long long plain = benchmark_run(target);
+
+	benchmark_hook->to = (int)benchmark_unhook;
+	benchmark_hook->hook();
+	unsigned long long unhooked = benchmark_run(target);
+	benchmark_hook->unhook();
+
+	benchmark_hook->to = (int)benchmark_trampoline;
+	benchmark_hook->hook();
+	unsigned long long trampolined = benchmark_run(target);
+	benchmark_hook->unhook();
+
+	Com_Printf("hook_benchmark: %d calls, cycles per call: plain %.1f, unhook/rehook %.1f, trampoline %.1f\n", BENCHMARK_CALLS,
+	           (double)plain / BENCHMARK_CALLS, (double)unhooked / BENCHMARK_CALLS, (double)trampolined / BENCHMARK_CALLS);
+}
@@ -6,16 +6,86 @@
 
 void cracking_hook_function(int from, int to);
 void cracking_hook_call(int from, int to);
+void cracking_benchmark_hooks();
+void cracking_profile_dump();
+
+static inline unsigned long long cracking_rdtsc()
+{
+	unsigned int lo, hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((unsigned long long)hi << 32) | lo;
+}
+
+#define MAX_HOOK_PROFILES 128
+
+enum
+{
+	HOOK_TYPE_CALL,
+	HOOK_TYPE_FUNCTION,
+	HOOK_TYPE_CHOOK
+};
+
+typedef struct
+{
+	int to;
+	int from; // first installed site
+	int sites;
+	int type;
+	bool instrumented;
+	unsigned int calls;
+	unsigned long long cycles;
+} hook_profile_t;
+
+hook_profile_t *cracking_profile_entry(int to);
+
+extern cvar_t *sv_hookProfile;
+
+// Counts calls and inclusive cycles of a hook handler while sv_hookProfile is set
+class cHookProfile
+{
+public:
+	cHookProfile(hook_profile_t *entry)
+	{
+		if (sv_hookProfile != NULL && sv_hookProfile->boolean)
+		{
+			this->entry = entry;
+			this->start = cracking_rdtsc();
+		}
+		else
+			this->entry = NULL;
+	}
+
+	~cHookProfile()
+	{
+		if (entry != NULL)
+		{
+			entry->calls++;
+			entry->cycles += cracking_rdtsc() - start;
+		}
+	}
+
+private:
+	hook_profile_t *entry;
+	unsigned long long start;
+};
+
+#define HOOK_PROFILE(function) \
+	static hook_profile_t *hook_profile_entry = cracking_profile_entry((int)function); \
+	cHookProfile hook_profile_scope(hook_profile_entry)
 
 class cHook
 {
 public:
 	int from;
 	int to;
+	int trampoline; // relocated prologue + jump back, 0 if the prologue could not be relocated
 	unsigned char oldCode[5];
 	cHook(int from, int to);
+	~cHook();
 	void hook();
 	void unhook();
+	int original();
+	void rehook();
 };
 
 #endif
@@ -659,9 +659,13 @@ struct leakyBucket_s
 	netadrtype_t type;
 	unsigned char adr[4];
 	int	lastTime;
-	signed char	burst;
+	int	burst;
 	long hash;
 	leakyBucket_t *prev, *next;
+	int prefix; // bits of adr this bucket covers
+	int key; // request kind for per-request buckets, 0 when shared by all requests
+	int expires;
+	leakyBucket_t *lruPrev, *lruNext;
 };
 
 typedef struct usercmd_s
@@ -1393,6 +1397,8 @@ typedef enum
 #define MAX_MODELS          256
 #define GENTITYNUM_BITS     10
 #define MAX_GENTITIES       ( 1 << GENTITYNUM_BITS )
+#define ENTITYNUM_NONE      ( MAX_GENTITIES - 1 )
+#define ENTITYNUM_WORLD     ( MAX_GENTITIES - 2 )
 #define MAX_ENT_CLUSTERS    16
 #define MAX_BPS_WINDOW 		20
 
@@ -2166,6 +2172,7 @@ struct bgs_s
 #define CONTENTS_NODROP         0x80000000
 
 #define CONTENTS_BODY           0x2000000
+#define CONTENTS_CORPSE         0x4000000
 #define CONTENTS_TRIGGER        0x40000000
 
 #define SURF_NOLIGHTMAP         0x0
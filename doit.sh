@@ -93,11 +93,21 @@ $cc $options $constants -c cracking.cpp -o objects_"$1"/cracking.opp
 echo "##### COMPILE $1 GSC.CPP #####"
 $cc $options $constants -c gsc.cpp -o objects_"$1"/gsc.opp
 
+if [ "$(< config.hpp grep '#define COMPILE_BANS' | grep -o '[0-9]')" == "1" ]; then
+	echo "##### COMPILE $1 GSC_BANS.CPP #####"
+	$cc $options $constants -c gsc_bans.cpp -o objects_"$1"/gsc_bans.opp
+fi
+
 if [ "$(< config.hpp grep '#define COMPILE_BOTS' | grep -o '[0-9]')" == "1" ]; then
 	echo "##### COMPILE $1 GSC_BOTS.CPP #####"
 	$cc $options $constants -c gsc_bots.cpp -o objects_"$1"/gsc_bots.opp
 fi
 
+if [ "$(< config.hpp grep '#define COMPILE_CHATFILTER' | grep -o '[0-9]')" == "1" ]; then
+	echo "##### COMPILE $1 GSC_CHATFILTER.CPP #####"
+	$cc $options $constants -c gsc_chatfilter.cpp -o objects_"$1"/gsc_chatfilter.opp
+fi
+
 if [ "$(< config.hpp grep '#define COMPILE_ENTITY' | grep -o '[0-9]')" == "1" ]; then
 	echo "##### COMPILE $1 GSC_ENTITY.CPP #####"
 	$cc $options $constants -c gsc_entity.cpp -o objects_"$1"/gsc_entity.opp
@@ -160,6 +170,12 @@ if [ "$(< config.hpp grep '#define COMPILE_JUMP' | grep -o '[0-9]')" == "1" ]; t
 	$cc $options $constants -c jump.cpp -o objects_"$1"/jump.opp
 fi
 
+if [ "$(< config.hpp grep '#define COMPILE_HTTPSERVER' | grep -o '[0-9]')" == "1" ]; then
+	echo "##### COMPILE $1 HTTPSERVER.CPP #####"
+	$cc $options $constants -c httpserver.cpp -o objects_"$1"/httpserver.opp
+	pthread_link="-lpthread"
+fi
+
 echo "##### COMPILE $1 LIBCOD.CPP #####"
 $cc $options $constants -c libcod.cpp -o objects_"$1"/libcod.opp
 
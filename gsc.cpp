@@ -95,10 +95,24 @@ scr_function_t scriptFunctions[] =
 	{"endparty", NULL_FUNC, 0},
 #endif
 
+#if COMPILE_BANS == 1
+	{"banload", gsc_bans_load, 0},
+	{"banadd", gsc_bans_add, 0},
+	{"banremove", gsc_bans_remove, 0},
+	{"banlookup", gsc_bans_lookup, 0},
+#endif
+
+#if COMPILE_CHATFILTER == 1
+	{"chatfilterload", gsc_chatfilter_load, 0},
+	{"chatfiltermatch", gsc_chatfilter_match, 0},
+	{"chatfilterrewrite", gsc_chatfilter_rewrite, 0},
+#endif
+
 #if COMPILE_EXEC == 1
 	{"exec", gsc_exec, 0},
 	{"exec_async_create", gsc_exec_async_create, 0},
 	{"exec_async_create_nosave", gsc_exec_async_create_nosave, 0},
+	{"exec_async_create_stream", gsc_exec_async_create_stream, 0},
 	{"exec_async_checkdone", gsc_exec_async_checkdone, 0},
 #endif
 
@@ -146,6 +160,11 @@ scr_function_t scriptFunctions[] =
 
 #if COMPILE_PLAYER == 1
 	{"kick2", gsc_kick_slot, 0},
+	{"getplayersinput", gsc_players_getinput, 0},
+	{"getplayersstate", gsc_players_getstate, 0},
+	{"lagcompensatedtrace", gsc_players_lagcompensatedtrace, 0},
+	{"registerplayercommand", gsc_players_registercommand, 0},
+	{"unregisterplayercommand", gsc_players_unregistercommand, 0},
 #endif
 
 #if COMPILE_SQLITE == 1
@@ -235,6 +254,8 @@ scr_function_t scriptFunctions[] =
 
 xfunction_t Scr_GetCustomFunction(const char **fname, qboolean *fdev)
 {
+	HOOK_PROFILE(Scr_GetCustomFunction);
+
 	xfunction_t m = Scr_GetFunction(fname, fdev);
 
 	if (m)
@@ -292,6 +313,8 @@ scr_method_t scriptMethods[] =
 	{"reloadbuttonpressed", gsc_player_button_reload, 0},
 	{"fragbuttonpressed", gsc_player_button_frag, 0},
 	{"smokebuttonpressed", gsc_player_button_smoke, 0},
+	{"getbuttons", gsc_player_getbuttons, 0},
+	{"getinput", gsc_player_getinput, 0},
 	{"getip", gsc_player_getip, 0},
 	{"getping", gsc_player_getping, 0},
 	{"getspectatorclient", gsc_player_spectatorclient_get, 0},
@@ -317,6 +340,12 @@ scr_method_t scriptMethods[] =
 	{"clienthasclientmuted", gsc_player_clienthasclientmuted, 0},
 	{"getlastgamestatesize", gsc_player_getlastgamestatesize, 0},
 	{"getfps", gsc_player_getfps, 0},
+	{"getcmdstats", gsc_player_getcmdstats, 0},
+	{"getangularvelocity", gsc_player_getangularvelocity, 0},
+	{"getbuttonintervals", gsc_player_getbuttonintervals, 0},
+	{"getaimstats", gsc_player_getaimstats, 0},
+	{"resetaimstats", gsc_player_resetaimstats, 0},
+	{"getlastcmdtime", gsc_player_getlastcmdtime, 0},
 	{"ismantling", gsc_player_ismantling, 0},
 	{"isonladder", gsc_player_isonladder, 0},
 	{"isbot", gsc_player_isbot, 0},
@@ -339,6 +368,8 @@ scr_method_t scriptMethods[] =
 
 xmethod_t Scr_GetCustomMethod(const char **fname, qboolean *fdev)
 {
+	HOOK_PROFILE(Scr_GetCustomMethod);
+
 	xmethod_t m = Scr_GetMethod(fname, fdev);
 
 	if (m)
@@ -20,6 +20,7 @@
 #include <execinfo.h> // stacktrace
 #include <stddef.h> // offsetof
 #include <sys/stat.h> // fsize
+#include <fcntl.h> // open
 #include <time.h>  // getsystemtime
 #include <ctype.h> // isdigit
 
@@ -28,10 +29,18 @@
 #include "functions.hpp"
 #include "cracking.hpp"
 
+#if COMPILE_BANS == 1
+#include "gsc_bans.hpp"
+#endif
+
 #if COMPILE_BOTS == 1
 #include "gsc_bots.hpp"
 #endif
 
+#if COMPILE_CHATFILTER == 1
+#include "gsc_chatfilter.hpp"
+#endif
+
 #if COMPILE_ENTITY == 1
 #include "gsc_entity.hpp"
 #endif
@@ -44,6 +53,10 @@
 #include "jump.hpp"
 #endif
 
+#if COMPILE_HTTPSERVER == 1
+#include "httpserver.hpp"
+#endif
+
 #if COMPILE_LEVEL == 1
 #include "gsc_level.hpp"
 #endif
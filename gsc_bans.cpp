@@ -0,0 +1,626 @@
+#include "gsc_bans.hpp"
+
+#if COMPILE_BANS == 1
+
+/*
+	Address bans live in a binary radix trie keyed on the IPv4 bits, so a CIDR range
+	is a single node and a lookup is at most 32 steps with no allocation. GUID bans
+	live in an open addressing hash set. Both point into one entry table holding the
+	reason, the GUID and where the ban came from.
+
+	Ban file format, one ban per line, reason optional:
+	<address>[/<prefix>] [reason]
+	<guid> [reason]
+*/
+typedef struct
+{
+	char reason[BAN_REASON_LENGTH];
+	char guid[BAN_GUID_LENGTH]; // empty for address bans
+	bool used;
+	bool fromFile; // removed by a reload when missing from the file
+	bool stale;
+	int nextFree;
+} banentry_t;
+
+typedef struct
+{
+	int child[2];
+	int entry; // -1 for none
+} bannode_t;
+
+#define BAN_GUID_EMPTY -1
+#define BAN_GUID_DELETED -2
+
+typedef struct
+{
+	unsigned int hash;
+	int entry;
+} banguid_t;
+
+static banentry_t *banEntries = NULL;
+static int banEntriesSize = 0;
+static int banEntriesFree = -1;
+
+static bannode_t *banNodes = NULL;
+static int banNodesCount = 0;
+static int banNodesSize = 0;
+static int banAddresses = 0;
+
+static banguid_t *banGuids = NULL;
+static int banGuidsSize = 0;
+static int banGuidsFilled = 0; // including deleted slots
+static int banGuidsCount = 0;
+
+static int Ban_NewEntry(const char *reason, const char *guid, bool fromFile)
+{
+	if (banEntriesFree == -1)
+	{
+		int size = banEntriesSize ? banEntriesSize * 2 : 256;
+
+		banEntries = (banentry_t *)realloc(banEntries, size * sizeof(banentry_t));
+
+		for (int i = size - 1; i >= banEntriesSize; i--)
+		{
+			banEntries[i].used = false;
+			banEntries[i].nextFree = banEntriesFree;
+			banEntriesFree = i;
+		}
+
+		banEntriesSize = size;
+	}
+
+	int index = banEntriesFree;
+	banentry_t *entry = &banEntries[index];
+
+	banEntriesFree = entry->nextFree;
+
+	strncpy(entry->reason, reason, sizeof(entry->reason) - 1);
+	entry->reason[sizeof(entry->reason) - 1] = '\0';
+	strcpy(entry->guid, guid);
+	entry->used = true;
+	entry->fromFile = fromFile;
+	entry->stale = false;
+
+	return index;
+}
+
+static void Ban_FreeEntry(int index)
+{
+	banEntries[index].used = false;
+	banEntries[index].nextFree = banEntriesFree;
+	banEntriesFree = index;
+}
+
+static void Ban_UpdateEntry(int index, const char *reason, bool fromFile)
+{
+	banentry_t *entry = &banEntries[index];
+
+	strncpy(entry->reason, reason, sizeof(entry->reason) - 1);
+	entry->reason[sizeof(entry->reason) - 1] = '\0';
+	entry->stale = false;
+
+	// Bans added by script are never dropped by a reload
+	if ( ! fromFile)
+		entry->fromFile = false;
+}
+
+static bool Ban_ParseAddress(const char *text, byte *ip, int *prefix)
+{
+	unsigned int a, b, c, d;
+	int bits = 32;
+	int length = 0;
+
+	if (sscanf(text, "%3u.%3u.%3u.%3u%n", &a, &b, &c, &d, &length) != 4)
+		return false;
+
+	if (text[length] == '/')
+	{
+		char *end;
+
+		bits = strtol(&text[length + 1], &end, 10);
+
+		if (end == &text[length + 1] || *end != '\0')
+			return false;
+	}
+	else if (text[length] != '\0')
+	{
+		return false;
+	}
+
+	if (a > 255 || b > 255 || c > 255 || d > 255 || bits < 0 || bits > 32)
+		return false;
+
+	ip[0] = a;
+	ip[1] = b;
+	ip[2] = c;
+	ip[3] = d;
+	*prefix = bits;
+
+	return true;
+}
+
+static bool Ban_ParseGuid(const char *text, char *guid)
+{
+	int length = strlen(text);
+
+	if (length == 0 || length >= BAN_GUID_LENGTH)
+		return false;
+
+	for (int i = 0; i <= length; i++)
+		guid[i] = tolower((unsigned char)text[i]);
+
+	return true;
+}
+
+static int Ban_NewNode()
+{
+	if (banNodesCount == banNodesSize)
+	{
+		banNodesSize = banNodesSize ? banNodesSize * 2 : 1024;
+		banNodes = (bannode_t *)realloc(banNodes, banNodesSize * sizeof(bannode_t));
+	}
+
+	bannode_t *node = &banNodes[banNodesCount];
+
+	node->child[0] = -1;
+	node->child[1] = -1;
+	node->entry = -1;
+
+	return banNodesCount++;
+}
+
+// Node for the exact prefix, -1 when it does not exist and create is false
+static int Ban_TrieNode(const byte *ip, int prefix, bool create)
+{
+	if (banNodesCount == 0)
+	{
+		if ( ! create)
+			return -1;
+
+		Ban_NewNode(); // root
+	}
+
+	int node = 0;
+
+	for (int bit = 0; bit < prefix; bit++)
+	{
+		int side = (ip[bit >> 3] >> (7 - (bit & 7))) & 1;
+		int child = banNodes[node].child[side];
+
+		if (child == -1)
+		{
+			if ( ! create)
+				return -1;
+
+			child = Ban_NewNode(); // may move banNodes
+			banNodes[node].child[side] = child;
+		}
+
+		node = child;
+	}
+
+	return node;
+}
+
+static unsigned int Ban_GuidHash(const char *guid)
+{
+	unsigned int hash = 2166136261u;
+
+	for (; *guid; guid++)
+		hash = (hash ^ (unsigned char)*guid) * 16777619u;
+
+	return hash;
+}
+
+// Slot holding guid, or the slot to insert it into when it is missing
+static int Ban_GuidSlot(const char *guid, unsigned int hash)
+{
+	int mask = banGuidsSize - 1;
+	int slot = hash & mask;
+	int insert = -1;
+
+	while (banGuids[slot].entry != BAN_GUID_EMPTY)
+	{
+		if (banGuids[slot].entry == BAN_GUID_DELETED)
+		{
+			if (insert == -1)
+				insert = slot;
+		}
+		else if (banGuids[slot].hash == hash && strcmp(banEntries[banGuids[slot].entry].guid, guid) == 0)
+		{
+			return slot;
+		}
+
+		slot = (slot + 1) & mask;
+	}
+
+	return insert != -1 ? insert : slot;
+}
+
+static void Ban_GuidResize(int size)
+{
+	banguid_t *old = banGuids;
+	int oldSize = banGuidsSize;
+
+	banGuids = (banguid_t *)malloc(size * sizeof(banguid_t));
+	banGuidsSize = size;
+	banGuidsFilled = banGuidsCount;
+
+	for (int i = 0; i < size; i++)
+		banGuids[i].entry = BAN_GUID_EMPTY;
+
+	for (int i = 0; i < oldSize; i++)
+	{
+		if (old[i].entry >= 0)
+			banGuids[Ban_GuidSlot(banEntries[old[i].entry].guid, old[i].hash)] = old[i];
+	}
+
+	free(old);
+}
+
+bool Ban_Add(const char *text, const char *reason, bool fromFile)
+{
+	byte ip[4];
+	int prefix;
+	char guid[BAN_GUID_LENGTH];
+
+	if (Ban_ParseAddress(text, ip, &prefix))
+	{
+		int node = Ban_TrieNode(ip, prefix, true);
+
+		if (banNodes[node].entry != -1)
+		{
+			Ban_UpdateEntry(banNodes[node].entry, reason, fromFile);
+		}
+		else
+		{
+			banNodes[node].entry = Ban_NewEntry(reason, "", fromFile);
+			banAddresses++;
+		}
+
+		return true;
+	}
+
+	if ( ! Ban_ParseGuid(text, guid))
+		return false;
+
+	// Keep the load factor under a half, counting deleted slots
+	if ((banGuidsFilled + 1) * 2 > banGuidsSize)
+	{
+		int size = banGuidsSize ? banGuidsSize : 64;
+
+		while ((banGuidsCount + 1) * 4 > size)
+			size *= 2;
+
+		Ban_GuidResize(size);
+	}
+
+	unsigned int hash = Ban_GuidHash(guid);
+	int slot = Ban_GuidSlot(guid, hash);
+
+	if (banGuids[slot].entry >= 0)
+	{
+		Ban_UpdateEntry(banGuids[slot].entry, reason, fromFile);
+		return true;
+	}
+
+	if (banGuids[slot].entry == BAN_GUID_EMPTY)
+		banGuidsFilled++;
+
+	banGuids[slot].hash = hash;
+	banGuids[slot].entry = Ban_NewEntry(reason, guid, fromFile);
+	banGuidsCount++;
+
+	return true;
+}
+
+bool Ban_Remove(const char *text)
+{
+	byte ip[4];
+	int prefix;
+	char guid[BAN_GUID_LENGTH];
+
+	if (Ban_ParseAddress(text, ip, &prefix))
+	{
+		int node = Ban_TrieNode(ip, prefix, false);
+
+		if (node == -1 || banNodes[node].entry == -1)
+			return false;
+
+		Ban_FreeEntry(banNodes[node].entry);
+		banNodes[node].entry = -1;
+		banAddresses--;
+
+		return true;
+	}
+
+	if ( ! Ban_ParseGuid(text, guid) || banGuidsCount == 0)
+		return false;
+
+	int slot = Ban_GuidSlot(guid, Ban_GuidHash(guid));
+
+	if (banGuids[slot].entry < 0)
+		return false;
+
+	Ban_FreeEntry(banGuids[slot].entry);
+	banGuids[slot].entry = BAN_GUID_DELETED;
+	banGuidsCount--;
+
+	return true;
+}
+
+// Reason of the longest matching prefix, NULL when the address is not banned
+const char *Ban_CheckAddress(const byte *ip)
+{
+	if (banAddresses == 0)
+		return NULL;
+
+	int node = 0;
+	int entry = banNodes[0].entry;
+
+	for (int bit = 0; bit < 32; bit++)
+	{
+		node = banNodes[node].child[(ip[bit >> 3] >> (7 - (bit & 7))) & 1];
+
+		if (node == -1)
+			break;
+
+		if (banNodes[node].entry != -1)
+			entry = banNodes[node].entry;
+	}
+
+	return entry != -1 ? banEntries[entry].reason : NULL;
+}
+
+const char *Ban_CheckGuid(const char *text)
+{
+	char guid[BAN_GUID_LENGTH];
+
+	if (banGuidsCount == 0 || ! Ban_ParseGuid(text, guid))
+		return NULL;
+
+	int slot = Ban_GuidSlot(guid, Ban_GuidHash(guid));
+
+	return banGuids[slot].entry >= 0 ? banEntries[banGuids[slot].entry].reason : NULL;
+}
+
+/*
+	Runs ahead of the engine's connectionless handling. Addresses are checked on every
+	packet, GUIDs on connect packets once the authorize server has filled them into the
+	challenge. Both lookups only read, a banned flood costs no allocation.
+*/
+const char *Ban_CheckConnectionless(netadr_t from, msg_t *msg)
+{
+	if (from.type != NA_IP)
+		return NULL;
+
+	const char *reason = Ban_CheckAddress(from.ip);
+
+	if (reason != NULL || banGuidsCount == 0)
+		return reason;
+
+	if (msg->cursize < 11 || memcmp(msg->data, "\xFF\xFF\xFF\xFF" "connect", 11) != 0)
+		return NULL;
+
+	for (int i = 0; i < (int)(sizeof(svs.challenges) / sizeof(svs.challenges[0])); i++)
+	{
+		challenge_t *challenge = &svs.challenges[i];
+
+		if (challenge->adr.port != from.port || memcmp(challenge->adr.ip, from.ip, 4) != 0)
+			continue;
+
+#if COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3
+		if (challenge->pbguid[0] != '\0' && (reason = Ban_CheckGuid(challenge->pbguid)) != NULL)
+			return reason;
+#endif
+
+		if (challenge->guid != 0)
+		{
+			char guid[16];
+
+			snprintf(guid, sizeof(guid), "%i", challenge->guid);
+
+			return Ban_CheckGuid(guid);
+		}
+
+		return NULL;
+	}
+
+	return NULL;
+}
+
+/*
+	Reloads are incremental: entries still in the file keep their slots, new ones are
+	added and file entries that disappeared are removed. Bans added by script survive.
+*/
+int Ban_Load(const char *filename)
+{
+	FILE *file = fopen(filename, "rb");
+
+	if (file == NULL)
+	{
+		Com_Printf("bans: could not open %s\n", filename);
+		return -1;
+	}
+
+	for (int i = 0; i < banEntriesSize; i++)
+	{
+		if (banEntries[i].used && banEntries[i].fromFile)
+			banEntries[i].stale = true;
+	}
+
+	int before = banAddresses + banGuidsCount;
+	int loaded = 0;
+	char line[256];
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		char *entry = line;
+
+		while (isspace((unsigned char)*entry))
+			entry++;
+
+		if (*entry == '\0' || *entry == '#' || (entry[0] == '/' && entry[1] == '/'))
+			continue;
+
+		char *reason = entry;
+
+		while (*reason != '\0' && !isspace((unsigned char)*reason))
+			reason++;
+
+		if (*reason != '\0')
+			*reason++ = '\0';
+
+		while (isspace((unsigned char)*reason))
+			reason++;
+
+		int length = strlen(reason);
+
+		while (length > 0 && isspace((unsigned char)reason[length - 1]))
+			reason[--length] = '\0';
+
+		if ( ! Ban_Add(entry, reason, true))
+		{
+			Com_Printf("bans: skipping invalid entry \"%s\"\n", entry);
+			continue;
+		}
+
+		loaded++;
+	}
+
+	fclose(file);
+
+	// Sweep file entries that were not seen again
+	int removed = 0;
+
+	for (int i = 0; i < banNodesCount; i++)
+	{
+		int entry = banNodes[i].entry;
+
+		if (entry != -1 && banEntries[entry].stale)
+		{
+			Ban_FreeEntry(entry);
+			banNodes[i].entry = -1;
+			banAddresses--;
+			removed++;
+		}
+	}
+
+	for (int i = 0; i < banGuidsSize; i++)
+	{
+		int entry = banGuids[i].entry;
+
+		if (entry >= 0 && banEntries[entry].stale)
+		{
+			Ban_FreeEntry(entry);
+			banGuids[i].entry = BAN_GUID_DELETED;
+			banGuidsCount--;
+			removed++;
+		}
+	}
+
+	int added = banAddresses + banGuidsCount - before + removed;
+
+	Com_Printf("bans: %i entries from %s, %i added, %i removed, %i addresses and %i guids banned\n", loaded, filename, added, removed, banAddresses, banGuidsCount);
+
+	return loaded;
+}
+
+void Ban_Reload_f()
+{
+	extern cvar_t *sv_banFile;
+
+	Ban_Load(sv_banFile->string);
+}
+
+void gsc_bans_load()
+{
+	extern cvar_t *sv_banFile;
+	char *filename = sv_banFile->string;
+
+	if (Scr_GetNumParam() > 0 && ! stackGetParamString(0, &filename))
+	{
+		stackError("gsc_bans_load() argument has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	int loaded = Ban_Load(filename);
+
+	if (loaded == -1)
+	{
+		stackError("gsc_bans_load() could not open %s", filename);
+		stackPushUndefined();
+		return;
+	}
+
+	stackPushInt(loaded);
+}
+
+void gsc_bans_add()
+{
+	char *entry;
+	char *reason = (char *)"";
+
+	if ( ! stackGetParams("s", &entry) || (Scr_GetNumParam() > 1 && ! stackGetParamString(1, &reason)))
+	{
+		stackError("gsc_bans_add() one or more arguments is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	if ( ! Ban_Add(entry, reason, false))
+	{
+		stackError("gsc_bans_add() invalid address or guid %s", entry);
+		stackPushUndefined();
+		return;
+	}
+
+	stackPushBool(qtrue);
+}
+
+void gsc_bans_remove()
+{
+	char *entry;
+
+	if ( ! stackGetParams("s", &entry))
+	{
+		stackError("gsc_bans_remove() argument is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	stackPushBool(Ban_Remove(entry) ? qtrue : qfalse);
+}
+
+// Reason for a banned address or guid, undefined when it is not banned
+void gsc_bans_lookup()
+{
+	char *entry;
+
+	if ( ! stackGetParams("s", &entry))
+	{
+		stackError("gsc_bans_lookup() argument is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	byte ip[4];
+	int prefix;
+	const char *reason;
+
+	if (Ban_ParseAddress(entry, ip, &prefix))
+		reason = Ban_CheckAddress(ip);
+	else
+		reason = Ban_CheckGuid(entry);
+
+	if (reason == NULL)
+	{
+		stackPushUndefined();
+		return;
+	}
+
+	stackPushString(reason);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _GSC_BANS_HPP_
+#define _GSC_BANS_HPP_
+
+/* gsc functions */
+#include "gsc.hpp"
+
+#define BAN_REASON_LENGTH 64
+#define BAN_GUID_LENGTH 64
+
+int Ban_Load(const char *filename);
+bool Ban_Add(const char *entry, const char *reason, bool fromFile);
+bool Ban_Remove(const char *entry);
+const char *Ban_CheckAddress(const byte *ip);
+const char *Ban_CheckGuid(const char *guid);
+const char *Ban_CheckConnectionless(netadr_t from, msg_t *msg);
+void Ban_Reload_f();
+
+void gsc_bans_load();
+void gsc_bans_add();
+void gsc_bans_remove();
+void gsc_bans_lookup();
+
+#endif
@@ -0,0 +1,471 @@
+#include "gsc_chatfilter.hpp"
+
+#if COMPILE_CHATFILTER == 1
+
+/*
+	Aho-Corasick automaton over the word list. Bytes that appear in no pattern share
+	class 0, so the transition table is states x (used bytes + 1) instead of states x 256.
+	All transitions are resolved at build time, matching costs one lookup per byte.
+
+	Word list format, one pattern per line, matched case insensitive:
+	<category> <pattern>
+*/
+typedef struct
+{
+	int numClasses;
+	unsigned char classes[256];
+	int numStates;
+	int *next;
+	int *output; // pattern ending in this state, -1 for none
+	int *outputLink; // nearest state on the fail chain with an output, -1 for none
+	int numPatterns;
+	int *patternLength;
+	int *patternCategory;
+	int numCategories;
+	char categories[CHATFILTER_MAX_CATEGORIES][32];
+} chatfilter_t;
+
+static chatfilter_t *chatfilter = NULL;
+
+static void ChatFilter_Free(chatfilter_t *filter)
+{
+	if (filter == NULL)
+		return;
+
+	free(filter->next);
+	free(filter->output);
+	free(filter->outputLink);
+	free(filter->patternLength);
+	free(filter->patternCategory);
+	free(filter);
+}
+
+static int ChatFilter_Category(chatfilter_t *filter, const char *name)
+{
+	for (int i = 0; i < filter->numCategories; i++)
+	{
+		if (strcasecmp(filter->categories[i], name) == 0)
+			return i;
+	}
+
+	if (filter->numCategories == CHATFILTER_MAX_CATEGORIES)
+		return -1;
+
+	strncpy(filter->categories[filter->numCategories], name, sizeof(filter->categories[0]) - 1);
+
+	return filter->numCategories++;
+}
+
+static void ChatFilter_Build(chatfilter_t *filter, char **patterns)
+{
+	int maxStates = 1;
+
+	for (int i = 0; i < filter->numPatterns; i++)
+		maxStates += filter->patternLength[i];
+
+	int nc = filter->numClasses;
+
+	filter->next = (int *)malloc(maxStates * nc * sizeof(int));
+	filter->output = (int *)malloc(maxStates * sizeof(int));
+	filter->outputLink = (int *)malloc(maxStates * sizeof(int));
+
+	memset(filter->next, -1, maxStates * nc * sizeof(int));
+	memset(filter->output, -1, maxStates * sizeof(int));
+	memset(filter->outputLink, -1, maxStates * sizeof(int));
+
+	// Trie
+	filter->numStates = 1;
+
+	for (int i = 0; i < filter->numPatterns; i++)
+	{
+		int state = 0;
+
+		for (int j = 0; j < filter->patternLength[i]; j++)
+		{
+			int *transition = &filter->next[state * nc + filter->classes[(unsigned char)patterns[i][j]]];
+
+			if (*transition == -1)
+				*transition = filter->numStates++;
+
+			state = *transition;
+		}
+
+		if (filter->output[state] == -1)
+			filter->output[state] = i; // duplicates keep the first category
+	}
+
+	// Fail links breadth first, missing transitions take the fail state's
+	int *fail = (int *)malloc(filter->numStates * sizeof(int));
+	int *queue = (int *)malloc(filter->numStates * sizeof(int));
+	int head = 0, tail = 0;
+
+	for (int c = 0; c < nc; c++)
+	{
+		int state = filter->next[c];
+
+		if (state == -1)
+		{
+			filter->next[c] = 0;
+		}
+		else
+		{
+			fail[state] = 0;
+			queue[tail++] = state;
+		}
+	}
+
+	while (head < tail)
+	{
+		int state = queue[head++];
+		int f = fail[state];
+
+		filter->outputLink[state] = filter->output[f] != -1 ? f : filter->outputLink[f];
+
+		for (int c = 0; c < nc; c++)
+		{
+			int *transition = &filter->next[state * nc + c];
+
+			if (*transition == -1)
+			{
+				*transition = filter->next[f * nc + c];
+			}
+			else
+			{
+				fail[*transition] = filter->next[f * nc + c];
+				queue[tail++] = *transition;
+			}
+		}
+	}
+
+	free(fail);
+	free(queue);
+}
+
+int ChatFilter_Load(const char *filename)
+{
+	FILE *file = fopen(filename, "rb");
+
+	if (file == NULL)
+	{
+		Com_Printf("chatfilter: could not open %s\n", filename);
+		return -1;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	char *buffer = (char *)malloc(size + 1);
+	size = fread(buffer, 1, size, file);
+	buffer[size] = '\0';
+	fclose(file);
+
+	int maxPatterns = 1;
+
+	for (long i = 0; i < size; i++)
+	{
+		if (buffer[i] == '\n')
+			maxPatterns++;
+	}
+
+	chatfilter_t *filter = (chatfilter_t *)calloc(1, sizeof(chatfilter_t));
+	char **patterns = (char **)malloc(maxPatterns * sizeof(char *));
+
+	filter->patternLength = (int *)malloc(maxPatterns * sizeof(int));
+	filter->patternCategory = (int *)malloc(maxPatterns * sizeof(int));
+	filter->numClasses = 1;
+
+	for (char *line = strtok(buffer, "\r\n"); line != NULL; line = strtok(NULL, "\r\n"))
+	{
+		while (isspace((unsigned char)*line))
+			line++;
+
+		if (*line == '\0' || *line == '#' || (line[0] == '/' && line[1] == '/'))
+			continue;
+
+		char *category = line;
+
+		while (*line != '\0' && !isspace((unsigned char)*line))
+			line++;
+
+		if (*line != '\0')
+			*line++ = '\0';
+
+		while (isspace((unsigned char)*line))
+			line++;
+
+		int length = strlen(line);
+
+		while (length > 0 && isspace((unsigned char)line[length - 1]))
+			line[--length] = '\0';
+
+		if (length == 0 || length > CHATFILTER_MAX_PATTERN)
+		{
+			Com_Printf("chatfilter: skipping pattern \"%s\" in category %s\n", line, category);
+			continue;
+		}
+
+		int index = ChatFilter_Category(filter, category);
+
+		if (index == -1)
+		{
+			Com_Printf("chatfilter: more than %i categories, skipping %s\n", CHATFILTER_MAX_CATEGORIES, category);
+			continue;
+		}
+
+		for (int i = 0; i < length; i++)
+		{
+			unsigned char c = tolower((unsigned char)line[i]);
+
+			line[i] = c;
+
+			if (filter->classes[c] == 0)
+				filter->classes[c] = filter->numClasses++;
+		}
+
+		patterns[filter->numPatterns] = line;
+		filter->patternLength[filter->numPatterns] = length;
+		filter->patternCategory[filter->numPatterns] = index;
+		filter->numPatterns++;
+	}
+
+	ChatFilter_Build(filter, patterns);
+
+	free(patterns);
+	free(buffer);
+
+	ChatFilter_Free(chatfilter);
+	chatfilter = filter;
+
+	Com_Printf("chatfilter: %i patterns in %i categories, %i states\n", filter->numPatterns, filter->numCategories, filter->numStates);
+
+	return filter->numPatterns;
+}
+
+/*
+	Runs text through the automaton in one pass, skipping color codes so "^1" can not
+	split a word. Without a rewrite buffer it stops at the first match (earliest end,
+	longest pattern there), otherwise it masks every match in rewrite with '*'.
+*/
+static int ChatFilter_Scan(const char *text, int *category, int *position, int *length, char *rewrite)
+{
+	if (chatfilter == NULL || chatfilter->numPatterns == 0)
+		return 0;
+
+	chatfilter_t *filter = chatfilter;
+	int offsets[CHATFILTER_MAX_PATTERN]; // text offsets of the last bytes fed
+	int fed = 0;
+	int state = 0;
+	int matches = 0;
+
+	for (int i = 0; text[i] != '\0'; i++)
+	{
+		if (text[i] == '^' && text[i + 1] >= '0' && text[i + 1] <= '9')
+		{
+			i++;
+			continue;
+		}
+
+		offsets[fed % CHATFILTER_MAX_PATTERN] = i;
+		fed++;
+
+		state = filter->next[state * filter->numClasses + filter->classes[(unsigned char)tolower((unsigned char)text[i])]];
+
+		for (int s = filter->output[state] != -1 ? state : filter->outputLink[state]; s != -1; s = filter->outputLink[s])
+		{
+			int pattern = filter->output[s];
+			int first = fed - filter->patternLength[pattern];
+
+			matches++;
+
+			if (rewrite == NULL)
+			{
+				*category = filter->patternCategory[pattern];
+				*position = offsets[first % CHATFILTER_MAX_PATTERN];
+				*length = i + 1 - *position;
+				return matches;
+			}
+
+			for (int j = first; j < fed; j++)
+				rewrite[offsets[j % CHATFILTER_MAX_PATTERN]] = '*';
+		}
+	}
+
+	return matches;
+}
+
+bool ChatFilter_Match(const char *text, int *category, int *position, int *length)
+{
+	return ChatFilter_Scan(text, category, position, length, NULL) > 0;
+}
+
+int ChatFilter_Rewrite(char *text)
+{
+	return ChatFilter_Scan(text, NULL, NULL, NULL, text);
+}
+
+const char *ChatFilter_CategoryName(int category)
+{
+	if (chatfilter == NULL || category < 0 || category >= chatfilter->numCategories)
+		return "";
+
+	return chatfilter->categories[category];
+}
+
+// Filters say/say_team in place, returns true when the command should be dropped
+bool ChatFilter_ClientCommand(int clientNum)
+{
+	extern cvar_t *sv_chatFilter;
+	extern int codecallback_chatfilter;
+
+	if ( ! sv_chatFilter->floatval || chatfilter == NULL || chatfilter->numPatterns == 0)
+		return false;
+
+	const char *command = Cmd_Argv(0);
+
+	if (strcasecmp(command, "say") != 0 && strcasecmp(command, "say_team") != 0)
+		return false;
+
+	// The game joins the arguments with spaces, match across them the same way
+	char message[COD2_MAX_STRINGLENGTH];
+	int args = Cmd_Argc();
+	int len = 0;
+
+	for (int i = 1; i < args && len < (int)sizeof(message) - 1; i++)
+	{
+		const char *arg = Cmd_Argv(i);
+		int n = strlen(arg);
+
+		if (i > 1)
+			message[len++] = ' ';
+
+		if (n > (int)sizeof(message) - 1 - len)
+			n = sizeof(message) - 1 - len;
+
+		memcpy(&message[len], arg, n);
+		len += n;
+	}
+
+	message[len] = '\0';
+
+	int category, position, length;
+
+	if ( ! ChatFilter_Match(message, &category, &position, &length))
+		return false;
+
+	if (codecallback_chatfilter && Scr_IsSystemActive())
+	{
+		stackPushString(message);
+		stackPushInt(position);
+		stackPushString(ChatFilter_CategoryName(category));
+
+		short ret = Scr_ExecEntThread(&g_entities[clientNum], codecallback_chatfilter, 3);
+		Scr_FreeThread(ret);
+	}
+
+	if ((int)sv_chatFilter->floatval == 2)
+		return true;
+
+	// Masking keeps the length, so the tokenized arguments can be patched in place
+	ChatFilter_Rewrite(message);
+
+	for (int i = 1, offset = 0; i < args && offset < len; i++)
+	{
+		char *arg = Cmd_Argv(i);
+		int n = strlen(arg);
+
+		if (n > len - offset)
+			n = len - offset;
+
+		memcpy(arg, &message[offset], n);
+		offset += n + 1;
+	}
+
+	return false;
+}
+
+void ChatFilter_Reload_f()
+{
+	extern cvar_t *sv_chatFilterFile;
+
+	ChatFilter_Load(sv_chatFilterFile->string);
+}
+
+void gsc_chatfilter_load()
+{
+	extern cvar_t *sv_chatFilterFile;
+	char *filename = sv_chatFilterFile->string;
+
+	if (Scr_GetNumParam() > 0 && ! stackGetParamString(0, &filename))
+	{
+		stackError("gsc_chatfilter_load() argument has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	int patterns = ChatFilter_Load(filename);
+
+	if (patterns == -1)
+	{
+		stackError("gsc_chatfilter_load() could not open %s", filename);
+		stackPushUndefined();
+		return;
+	}
+
+	stackPushInt(patterns);
+}
+
+// [category, position, length] of the first match, undefined when the text is clean
+void gsc_chatfilter_match()
+{
+	char *text;
+
+	if ( ! stackGetParams("s", &text))
+	{
+		stackError("gsc_chatfilter_match() argument is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	int category, position, length;
+
+	if ( ! ChatFilter_Match(text, &category, &position, &length))
+	{
+		stackPushUndefined();
+		return;
+	}
+
+	stackPushArray();
+
+	stackPushString(ChatFilter_CategoryName(category));
+	stackPushArrayLast();
+
+	stackPushInt(position);
+	stackPushArrayLast();
+
+	stackPushInt(length);
+	stackPushArrayLast();
+}
+
+void gsc_chatfilter_rewrite()
+{
+	char *text;
+
+	if ( ! stackGetParams("s", &text))
+	{
+		stackError("gsc_chatfilter_rewrite() argument is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	char rewritten[COD2_MAX_STRINGLENGTH];
+
+	strncpy(rewritten, text, sizeof(rewritten) - 1);
+	rewritten[sizeof(rewritten) - 1] = '\0';
+
+	ChatFilter_Rewrite(rewritten);
+
+	stackPushString(rewritten);
+}
+
+#endif
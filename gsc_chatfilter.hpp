@@ -0,0 +1,21 @@
+#ifndef _GSC_CHATFILTER_HPP_
+#define _GSC_CHATFILTER_HPP_
+
+/* gsc functions */
+#include "gsc.hpp"
+
+#define CHATFILTER_MAX_PATTERN 64 // longest pattern in bytes
+#define CHATFILTER_MAX_CATEGORIES 32
+
+int ChatFilter_Load(const char *filename);
+bool ChatFilter_Match(const char *text, int *category, int *position, int *length);
+int ChatFilter_Rewrite(char *text);
+const char *ChatFilter_CategoryName(int category);
+bool ChatFilter_ClientCommand(int clientNum);
+void ChatFilter_Reload_f();
+
+void gsc_chatfilter_load();
+void gsc_chatfilter_match();
+void gsc_chatfilter_rewrite();
+
+#endif
@@ -3,6 +3,18 @@
 #if COMPILE_EXEC == 1
 
 #include <pthread.h>
+#include <spawn.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+#define EXEC_STREAM_MAX_EVENTS 32
+#define EXEC_STREAM_POLL_MSEC 100
+#define EXEC_STREAM_READ_SIZE 4096
+
+extern char **environ;
 
 enum
 {
@@ -41,6 +53,44 @@ struct exec_async_task
 
 exec_async_task *first_exec_async_task = NULL;
 
+enum
+{
+	STREAM_RUNNING,
+	STREAM_DONE,
+	STREAM_TIMEOUT,
+	STREAM_ERROR
+};
+
+struct exec_stream_task
+{
+	exec_stream_task *prev;
+	exec_stream_task *next;
+	char command[COD2_MAX_STRINGLENGTH];
+	int callback;
+	pid_t pid;
+	int fd;
+	int timeout;
+	long long started;
+	int status;
+	bool done;
+	exec_outputline *output;
+	exec_outputline *output_last;
+	char partial[COD2_MAX_STRINGLENGTH];
+	int partial_length;
+	unsigned int levelId;
+	bool hasargument;
+	int valueType;
+	int intValue;
+	float floatValue;
+	char stringValue[COD2_MAX_STRINGLENGTH];
+	vec3_t vectorValue;
+	unsigned int objectValue;
+};
+
+exec_stream_task *first_exec_stream_task = NULL;
+pthread_mutex_t exec_stream_mutex = PTHREAD_MUTEX_INITIALIZER;
+int exec_stream_epoll = -1;
+
 void gsc_exec()
 {
 	char *command;
@@ -339,6 +389,407 @@ void gsc_exec_async_create_nosave()
 	stackPushInt(1);
 }
 
+// 64 bit, an int of monotonic milliseconds wraps after 24.8 days
+long long exec_stream_milliseconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void exec_stream_addline(exec_stream_task *task)
+{
+	exec_outputline *output = new exec_outputline;
+
+	memcpy(output->content, task->partial, task->partial_length);
+	output->content[task->partial_length] = '\0';
+	output->next = NULL;
+
+	if (task->output_last != NULL)
+		task->output_last->next = output;
+	else
+		task->output = output;
+
+	task->output_last = output;
+	task->partial_length = 0;
+}
+
+void exec_stream_read(exec_stream_task *task)
+{
+	char buffer[EXEC_STREAM_READ_SIZE];
+
+	while (task->fd != -1)
+	{
+		int len = read(task->fd, buffer, sizeof(buffer));
+
+		if (len < 0 && errno == EINTR)
+			continue;
+
+		if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return; // drained, wait for next event
+
+		if (len <= 0)
+		{
+			// eof or broken pipe, child is reaped by the handler loop
+			epoll_ctl(exec_stream_epoll, EPOLL_CTL_DEL, task->fd, NULL);
+			close(task->fd);
+			task->fd = -1;
+			return;
+		}
+
+		for (int i = 0; i < len; i++)
+		{
+			if (buffer[i] == '\n')
+			{
+				exec_stream_addline(task);
+				continue;
+			}
+
+			// Overlong lines are split, the byte that did not fit starts the next one
+			if (task->partial_length == COD2_MAX_STRINGLENGTH - 1)
+				exec_stream_addline(task);
+
+			task->partial[task->partial_length++] = buffer[i];
+		}
+	}
+}
+
+void *exec_stream_handler(void *dummy)
+{
+	struct epoll_event events[EXEC_STREAM_MAX_EVENTS];
+
+	while (1)
+	{
+		int count = epoll_wait(exec_stream_epoll, events, EXEC_STREAM_MAX_EVENTS, EXEC_STREAM_POLL_MSEC);
+
+		pthread_mutex_lock(&exec_stream_mutex);
+
+		for (int i = 0; i < count; i++)
+			exec_stream_read((exec_stream_task *)events[i].data.ptr);
+
+		long long now = exec_stream_milliseconds();
+		exec_stream_task *task = first_exec_stream_task;
+
+		for (; task != NULL; task = task->next)
+		{
+			if (task->done)
+				continue;
+
+			// Hard timeout, kill the whole process group of the shell
+			if (task->timeout && task->status == STREAM_RUNNING && now - task->started >= task->timeout)
+			{
+				Com_DPrintf("exec_stream_handler() killing timed out command: %s\n", task->command);
+				kill(-task->pid, SIGKILL);
+				task->status = STREAM_TIMEOUT;
+			}
+
+			if (task->fd != -1)
+				continue;
+
+			int ret = waitpid(task->pid, NULL, WNOHANG);
+
+			if (ret == 0)
+				continue; // stdout closed but child still running
+
+			if (task->partial_length)
+				exec_stream_addline(task);
+
+			if (task->status == STREAM_RUNNING)
+				task->status = STREAM_DONE;
+
+			task->done = true;
+		}
+
+		pthread_mutex_unlock(&exec_stream_mutex);
+	}
+
+	return NULL;
+}
+
+void gsc_exec_async_create_stream()
+{
+	char *command;
+	int callback;
+	int timeout;
+
+	if (!stackGetParamString(0, &command))
+	{
+		stackError("gsc_exec_async_create_stream() argument is undefined or has wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	if (!stackGetParamFunction(1, &callback))
+	{
+		stackError("gsc_exec_async_create_stream() callback is undefined or has wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	if (!stackGetParamInt(2, &timeout))
+		timeout = 0;
+
+	if (timeout < 0)
+	{
+		stackError("gsc_exec_async_create_stream() timeout must be equal or above zero");
+		stackPushUndefined();
+		return;
+	}
+
+	Com_DPrintf("gsc_exec_async_create_stream() executing: %s\n", command);
+
+	pthread_mutex_lock(&exec_stream_mutex);
+
+	if (exec_stream_epoll == -1)
+	{
+		exec_stream_epoll = epoll_create(EXEC_STREAM_MAX_EVENTS);
+
+		if (exec_stream_epoll == -1)
+		{
+			pthread_mutex_unlock(&exec_stream_mutex);
+			stackError("gsc_exec_async_create_stream() error creating epoll instance!");
+			stackPushUndefined();
+			return;
+		}
+
+		pthread_t exec_stream_doer;
+
+		if (pthread_create(&exec_stream_doer, NULL, exec_stream_handler, NULL) != 0 || pthread_detach(exec_stream_doer) != 0)
+		{
+			close(exec_stream_epoll);
+			exec_stream_epoll = -1;
+			pthread_mutex_unlock(&exec_stream_mutex);
+			stackError("gsc_exec_async_create_stream() error creating exec stream handler thread!");
+			stackPushUndefined();
+			return;
+		}
+	}
+
+	pthread_mutex_unlock(&exec_stream_mutex);
+
+	int pipefd[2];
+
+	// Both ends close-on-exec, so no other child inherits the write end and holds off
+	// the EOF. The dup2 onto stdout in the spawned child clears the flag there.
+	if (pipe2(pipefd, O_CLOEXEC) != 0)
+	{
+		stackPushUndefined();
+		return;
+	}
+
+	fcntl(pipefd[0], F_SETFL, fcntl(pipefd[0], F_GETFL) | O_NONBLOCK);
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, pipefd[1], STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&actions, pipefd[1]);
+
+	// Own process group, so a timeout also kills everything the shell started
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+	posix_spawnattr_setpgroup(&attr, 0);
+
+	pid_t pid;
+	char *argv[] = { (char *)"sh", (char *)"-c", command, NULL };
+	int spawned = posix_spawn(&pid, "/bin/sh", &actions, &attr, argv, environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+	close(pipefd[1]);
+
+	if (spawned != 0)
+	{
+		close(pipefd[0]);
+		stackPushUndefined();
+		return;
+	}
+
+	exec_stream_task *newtask = new exec_stream_task;
+
+	strncpy(newtask->command, command, COD2_MAX_STRINGLENGTH - 1);
+	newtask->command[COD2_MAX_STRINGLENGTH - 1] = '\0';
+	newtask->callback = callback;
+	newtask->pid = pid;
+	newtask->fd = pipefd[0];
+	newtask->timeout = timeout;
+	newtask->started = exec_stream_milliseconds();
+	newtask->status = STREAM_RUNNING;
+	newtask->done = false;
+	newtask->output = NULL;
+	newtask->output_last = NULL;
+	newtask->partial_length = 0;
+	newtask->levelId = scrVarPub.levelId;
+	newtask->hasargument = true;
+
+	int valueInt;
+	float valueFloat;
+	char *valueString;
+	vec3_t valueVector;
+	unsigned int valueObject;
+
+	if (stackGetParamInt(3, &valueInt))
+	{
+		newtask->valueType = INT_VALUE;
+		newtask->intValue = valueInt;
+	}
+	else if (stackGetParamFloat(3, &valueFloat))
+	{
+		newtask->valueType = FLOAT_VALUE;
+		newtask->floatValue = valueFloat;
+	}
+	else if (stackGetParamString(3, &valueString))
+	{
+		newtask->valueType = STRING_VALUE;
+		strcpy(newtask->stringValue, valueString);
+	}
+	else if (stackGetParamVector(3, valueVector))
+	{
+		newtask->valueType = VECTOR_VALUE;
+		newtask->vectorValue[0] = valueVector[0];
+		newtask->vectorValue[1] = valueVector[1];
+		newtask->vectorValue[2] = valueVector[2];
+	}
+	else if (stackGetParamObject(3, &valueObject))
+	{
+		newtask->valueType = OBJECT_VALUE;
+		newtask->objectValue = valueObject;
+	}
+	else
+		newtask->hasargument = false;
+
+	pthread_mutex_lock(&exec_stream_mutex);
+
+	newtask->prev = NULL;
+	newtask->next = first_exec_stream_task;
+
+	if (first_exec_stream_task != NULL)
+		first_exec_stream_task->prev = newtask;
+
+	first_exec_stream_task = newtask;
+
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = newtask;
+
+	if (epoll_ctl(exec_stream_epoll, EPOLL_CTL_ADD, newtask->fd, &event) != 0)
+	{
+		// Handler thread reaps it as if the pipe closed
+		close(newtask->fd);
+		newtask->fd = -1;
+		kill(-newtask->pid, SIGKILL);
+		newtask->status = STREAM_ERROR;
+	}
+
+	pthread_mutex_unlock(&exec_stream_mutex);
+
+	stackPushInt(pid);
+}
+
+void exec_stream_checkdone()
+{
+	const char *statusNames[] = { "running", "done", "timeout", "error" };
+
+	pthread_mutex_lock(&exec_stream_mutex);
+
+	exec_stream_task *current = first_exec_stream_task;
+
+	while (current != NULL)
+	{
+		exec_stream_task *task = current;
+		current = current->next;
+
+		if (task->output == NULL && !task->done)
+			continue;
+
+		// Take the lines gathered since the last check, the handler keeps appending to a fresh list
+		exec_outputline *output = task->output;
+		task->output = NULL;
+		task->output_last = NULL;
+
+		bool done = task->done;
+		int status = task->status;
+
+		if (done)
+		{
+			if (task->next != NULL)
+				task->next->prev = task->prev;
+
+			if (task->prev != NULL)
+				task->prev->next = task->next;
+			else
+				first_exec_stream_task = task->next;
+		}
+
+		pthread_mutex_unlock(&exec_stream_mutex);
+
+		//push to cod
+		if (Scr_IsSystemActive() && (scrVarPub.levelId == task->levelId))
+		{
+			if (task->hasargument)
+			{
+				switch(task->valueType)
+				{
+				case INT_VALUE:
+					stackPushInt(task->intValue);
+					break;
+
+				case FLOAT_VALUE:
+					stackPushFloat(task->floatValue);
+					break;
+
+				case STRING_VALUE:
+					stackPushString(task->stringValue);
+					break;
+
+				case VECTOR_VALUE:
+					stackPushVector(task->vectorValue);
+					break;
+
+				case OBJECT_VALUE:
+					stackPushObject(task->objectValue);
+					break;
+
+				default:
+					stackPushUndefined();
+					break;
+				}
+			}
+
+			stackPushString(statusNames[status]);
+
+			stackPushArray();
+
+			while (output != NULL)
+			{
+				exec_outputline *next = output->next;
+				stackPushString(output->content);
+				stackPushArrayLast();
+				delete output;
+				output = next;
+			}
+
+			short ret = Scr_ExecThread(task->callback, 2 + task->hasargument);
+			Scr_FreeThread(ret);
+		}
+
+		while (output != NULL)
+		{
+			exec_outputline *next = output->next;
+			delete output;
+			output = next;
+		}
+
+		if (done)
+			delete task;
+
+		pthread_mutex_lock(&exec_stream_mutex);
+	}
+
+	pthread_mutex_unlock(&exec_stream_mutex);
+}
+
 void gsc_exec_async_checkdone()
 {
 	exec_async_task *current = first_exec_async_task;
@@ -411,6 +862,8 @@ void gsc_exec_async_checkdone()
 			delete task;
 		}
 	}
+
+	exec_stream_checkdone();
 }
 
 #endif
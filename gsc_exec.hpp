@@ -7,6 +7,7 @@
 void gsc_exec();
 void gsc_exec_async_create();
 void gsc_exec_async_create_nosave();
+void gsc_exec_async_create_stream();
 void gsc_exec_async_checkdone();
 
 #endif
@@ -88,9 +88,8 @@ void gsc_player_get_userinfo(scr_entref_t id)
 		return;
 	}
 
-	client_t *client = &svs.clients[id];
-
-	char *val = Info_ValueForKey(client->userinfo, key);
+	const char *SV_UserinfoValue(int clientNum, const char *key);
+	const char *val = SV_UserinfoValue(id, key);
 
 	if (strlen(val))
 		stackPushString(val);
@@ -119,6 +118,10 @@ void gsc_player_set_userinfo(scr_entref_t id)
 	client_t *client = &svs.clients[id];
 
 	Info_SetValueForKey(client->userinfo, key, value);
+
+	void SV_RefreshUserinfo(int clientNum);
+	SV_RefreshUserinfo(id);
+
 	stackPushBool(qtrue);
 }
 
@@ -276,6 +279,52 @@ void gsc_player_button_smoke(scr_entref_t id)
 	stackPushBool(client->lastUsercmd.buttons & KEY_MASK_SMOKE ? qtrue : qfalse);
 }
 
+void gsc_player_getbuttons(scr_entref_t id)
+{
+	if (id >= MAX_CLIENTS)
+	{
+		stackError("gsc_player_getbuttons() entity %i is not a player", id);
+		stackPushUndefined();
+		return;
+	}
+
+	client_t *client = &svs.clients[id];
+
+	stackPushInt(client->lastUsercmd.buttons);
+}
+
+// [buttons, forwardmove, rightmove, viewangles]
+void player_pushinput(client_t *client, gentity_t *entity)
+{
+	stackPushArray();
+
+	stackPushInt(client->lastUsercmd.buttons);
+	stackPushArrayLast();
+
+	stackPushInt(client->lastUsercmd.forwardmove);
+	stackPushArrayLast();
+
+	stackPushInt(client->lastUsercmd.rightmove);
+	stackPushArrayLast();
+
+	stackPushVector(entity->client->ps.viewangles);
+	stackPushArrayLast();
+}
+
+void gsc_player_getinput(scr_entref_t id)
+{
+	gentity_t *entity = &g_entities[id];
+
+	if (id >= MAX_CLIENTS || entity->client == NULL)
+	{
+		stackError("gsc_player_getinput() entity %i is not a player", id);
+		stackPushUndefined();
+		return;
+	}
+
+	player_pushinput(&svs.clients[id], entity);
+}
+
 void gsc_player_stance_get(scr_entref_t id)
 {
 	gentity_t *entity = &g_entities[id];
@@ -474,6 +523,9 @@ void gsc_player_renameclient(scr_entref_t id)
 	Info_SetValueForKey(client->userinfo, "name", name);
 	strcpy(client->name, name);
 
+	void SV_RefreshUserinfo(int clientNum);
+	SV_RefreshUserinfo(id);
+
 	stackPushBool(qtrue);
 }
 
@@ -780,6 +832,148 @@ void gsc_kick_slot()
 	stackPushBool(qtrue);
 }
 
+// Input of all active players at once: array of [player, [buttons, forwardmove, rightmove, viewangles]]
+void gsc_players_getinput()
+{
+	stackPushArray();
+
+	for (int i = 0; i < MAX_CLIENTS; i++)
+	{
+		client_t *client = &svs.clients[i];
+
+		if (client->state != CS_ACTIVE || client->gentity == NULL || client->gentity->client == NULL)
+			continue;
+
+		stackPushArray();
+
+		stackPushEntity(client->gentity);
+		stackPushArrayLast();
+
+		player_pushinput(client, client->gentity);
+		stackPushArrayLast();
+
+		stackPushArrayLast();
+	}
+}
+
+/*
+	getplayersstate(format) walks the active clients once and returns one array
+	per format character, each holding that field for every player in slot order:
+
+	e = entity, n = client number, o = origin, a = viewangles, v = velocity,
+	s = stance, h = health, t = team, S = session state, p = ping, f = fps,
+	b = buttons
+*/
+void gsc_players_getstate()
+{
+	char *format;
+
+	if ( ! stackGetParams("s", &format))
+	{
+		stackError("gsc_players_getstate() argument is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	int len = strlen(format);
+
+	for (int i = 0; i < len; i++)
+	{
+		if (strchr("enoavshtSpfb", format[i]) == NULL)
+		{
+			stackError("gsc_players_getstate() unknown field '%c' in format", format[i]);
+			stackPushUndefined();
+			return;
+		}
+	}
+
+	extern int clientfps[MAX_CLIENTS];
+	int active[MAX_CLIENTS];
+	int count = 0;
+
+	for (int i = 0; i < MAX_CLIENTS; i++)
+	{
+		client_t *client = &svs.clients[i];
+
+		if (client->state == CS_ACTIVE && client->gentity != NULL && client->gentity->client != NULL)
+			active[count++] = i;
+	}
+
+	stackPushArray();
+
+	for (int i = 0; i < len; i++)
+	{
+		stackPushArray();
+
+		for (int j = 0; j < count; j++)
+		{
+			int num = active[j];
+			client_t *client = &svs.clients[num];
+			gentity_t *entity = client->gentity;
+
+			switch (format[i])
+			{
+			case 'e':
+				stackPushEntity(entity);
+				break;
+
+			case 'n':
+				stackPushInt(num);
+				break;
+
+			case 'o':
+				stackPushVector(entity->client->ps.origin);
+				break;
+
+			case 'a':
+				stackPushVector(entity->client->ps.viewangles);
+				break;
+
+			case 'v':
+				stackPushVector(entity->client->ps.velocity);
+				break;
+
+			case 's':
+				if (entity->s.eFlags & EF_CROUCHING)
+					stackPushString("duck");
+				else if (entity->s.eFlags & EF_PRONE)
+					stackPushString("lie");
+				else
+					stackPushString("stand");
+				break;
+
+			case 'h':
+				stackPushInt(entity->healthPoints);
+				break;
+
+			case 't':
+				stackPushInt(entity->client->sess.team);
+				break;
+
+			case 'S':
+				stackPushInt(entity->client->sess.state);
+				break;
+
+			case 'p':
+				stackPushInt(client->ping);
+				break;
+
+			case 'f':
+				stackPushInt(clientfps[num]);
+				break;
+
+			case 'b':
+				stackPushInt(client->lastUsercmd.buttons);
+				break;
+			}
+
+			stackPushArrayLast();
+		}
+
+		stackPushArrayLast();
+	}
+}
+
 void gsc_player_setguid(scr_entref_t id)
 {
 	int guid;
@@ -851,6 +1045,266 @@ void gsc_player_getfps(scr_entref_t id)
 	stackPushInt(clientfps[id]);
 }
 
+// [fps, minfps, maxfps, interval mean, interval jitter, drift, drift mean]
+void gsc_player_getcmdstats(scr_entref_t id)
+{
+	if (id >= MAX_CLIENTS)
+	{
+		stackError("gsc_player_getcmdstats() entity %i is not a player", id);
+		stackPushUndefined();
+		return;
+	}
+
+	extern int clientfps[MAX_CLIENTS];
+	extern clientcmdstats_t clientcmdstats[MAX_CLIENTS];
+	clientcmdstats_t *stats = &clientcmdstats[id];
+
+	int minfps = clientfps[id];
+	int maxfps = clientfps[id];
+	int history = stats->fpsHistoryCount < CMDSTATS_HISTORY ? stats->fpsHistoryCount : CMDSTATS_HISTORY;
+
+	for (int i = 0; i < history; i++)
+	{
+		if (stats->fpsHistory[i] < minfps)
+			minfps = stats->fpsHistory[i];
+
+		if (stats->fpsHistory[i] > maxfps)
+			maxfps = stats->fpsHistory[i];
+	}
+
+	stackPushArray();
+
+	stackPushInt(clientfps[id]);
+	stackPushArrayLast();
+
+	stackPushInt(minfps);
+	stackPushArrayLast();
+
+	stackPushInt(maxfps);
+	stackPushArrayLast();
+
+	stackPushFloat(stats->intervalMean);
+	stackPushArrayLast();
+
+	stackPushFloat(stats->intervalJitter);
+	stackPushArrayLast();
+
+	stackPushInt(stats->drift);
+	stackPushArrayLast();
+
+	stackPushFloat(stats->driftMean);
+	stackPushArrayLast();
+}
+
+// Oldest command of the history that is not older than msec (0 = whole history)
+unsigned int player_usercmdhistory_start(usercmdhistory_t *history, int msec)
+{
+	unsigned int stored = history->count < USERCMD_HISTORY ? history->count : USERCMD_HISTORY;
+	unsigned int start = history->count - stored;
+
+	if (!stored || msec <= 0)
+		return start;
+
+	int newest = history->cmds[(history->count - 1) % USERCMD_HISTORY].serverTime;
+
+	while (start < history->count - 1 && newest - history->cmds[start % USERCMD_HISTORY].serverTime > msec)
+		start++;
+
+	return start;
+}
+
+// [max, mean] view angle change in degrees per second over the last msec of usercmds
+void gsc_player_getangularvelocity(scr_entref_t id)
+{
+	int msec;
+
+	if ( ! stackGetParams("i", &msec))
+		msec = 0;
+
+	if (id >= MAX_CLIENTS)
+	{
+		stackError("gsc_player_getangularvelocity() entity %i is not a player", id);
+		stackPushUndefined();
+		return;
+	}
+
+	extern usercmdhistory_t usercmdhistory[MAX_CLIENTS];
+	usercmdhistory_t *history = &usercmdhistory[id];
+
+	float max = 0;
+	float total = 0;
+	int samples = 0;
+
+	for (unsigned int i = player_usercmdhistory_start(history, msec) + 1; i < history->count; i++)
+	{
+		usercmd_t *prev = &history->cmds[(i - 1) % USERCMD_HISTORY];
+		usercmd_t *cmd = &history->cmds[i % USERCMD_HISTORY];
+
+		int dt = cmd->serverTime - prev->serverTime;
+
+		if (dt <= 0)
+			continue;
+
+		float pitch = SHORT2ANGLE((short)(cmd->angles[0] - prev->angles[0]));
+		float yaw = SHORT2ANGLE((short)(cmd->angles[1] - prev->angles[1]));
+		float velocity = sqrt(pitch * pitch + yaw * yaw) * 1000 / dt;
+
+		if (velocity > max)
+			max = velocity;
+
+		total += velocity;
+		samples++;
+	}
+
+	stackPushArray();
+
+	stackPushFloat(max);
+	stackPushArrayLast();
+
+	stackPushFloat(samples ? total / samples : 0);
+	stackPushArrayLast();
+}
+
+// Histogram of the time between presses of the given button mask, the last bucket collects everything above
+void gsc_player_getbuttonintervals(scr_entref_t id)
+{
+	int mask, bucketsize, buckets;
+
+	if ( ! stackGetParams("iii", &mask, &bucketsize, &buckets))
+	{
+		stackError("gsc_player_getbuttonintervals() one or more arguments is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	if (bucketsize <= 0 || buckets <= 0 || buckets > 64)
+	{
+		stackError("gsc_player_getbuttonintervals() bucket size must be above zero and bucket count between 1 and 64");
+		stackPushUndefined();
+		return;
+	}
+
+	if (id >= MAX_CLIENTS)
+	{
+		stackError("gsc_player_getbuttonintervals() entity %i is not a player", id);
+		stackPushUndefined();
+		return;
+	}
+
+	extern usercmdhistory_t usercmdhistory[MAX_CLIENTS];
+	usercmdhistory_t *history = &usercmdhistory[id];
+
+	int histogram[64] = {0};
+	int lastPress = -1;
+
+	for (unsigned int i = player_usercmdhistory_start(history, 0) + 1; i < history->count; i++)
+	{
+		usercmd_t *prev = &history->cmds[(i - 1) % USERCMD_HISTORY];
+		usercmd_t *cmd = &history->cmds[i % USERCMD_HISTORY];
+
+		if (!(cmd->buttons & mask) || (prev->buttons & mask))
+			continue;
+
+		if (lastPress != -1)
+		{
+			int bucket = (cmd->serverTime - lastPress) / bucketsize;
+
+			if (bucket >= buckets)
+				bucket = buckets - 1;
+
+			if (bucket >= 0)
+				histogram[bucket]++;
+		}
+
+		lastPress = cmd->serverTime;
+	}
+
+	stackPushArray();
+
+	for (int i = 0; i < buckets; i++)
+	{
+		stackPushInt(histogram[i]);
+		stackPushArrayLast();
+	}
+}
+
+// [max delta, max velocity, max acceleration, snaps, recent snaps, flagged]
+void gsc_player_getaimstats(scr_entref_t id)
+{
+	if (id >= MAX_CLIENTS)
+	{
+		stackError("gsc_player_getaimstats() entity %i is not a player", id);
+		stackPushUndefined();
+		return;
+	}
+
+	extern aimstats_t aimstats[MAX_CLIENTS];
+	extern cvar_t *sv_aimSnapFlagCount;
+	aimstats_t *stats = &aimstats[id];
+
+	int recent = 0;
+
+	for (int i = 0; i < AIMSTATS_SNAPS && i < stats->snaps; i++)
+	{
+		if (svs.time - stats->snapTimes[i] <= AIMSTATS_WINDOW)
+			recent++;
+	}
+
+	stackPushArray();
+
+	stackPushFloat(stats->maxDelta);
+	stackPushArrayLast();
+
+	stackPushFloat(stats->maxVelocity);
+	stackPushArrayLast();
+
+	stackPushFloat(stats->maxAcceleration);
+	stackPushArrayLast();
+
+	stackPushInt(stats->snaps);
+	stackPushArrayLast();
+
+	stackPushInt(recent);
+	stackPushArrayLast();
+
+	stackPushBool(recent >= sv_aimSnapFlagCount->floatval ? qtrue : qfalse);
+	stackPushArrayLast();
+}
+
+void gsc_player_resetaimstats(scr_entref_t id)
+{
+	if (id >= MAX_CLIENTS)
+	{
+		stackError("gsc_player_resetaimstats() entity %i is not a player", id);
+		stackPushUndefined();
+		return;
+	}
+
+	extern aimstats_t aimstats[MAX_CLIENTS];
+	aimstats_t *stats = &aimstats[id];
+
+	stats->maxDelta = 0;
+	stats->maxVelocity = 0;
+	stats->maxAcceleration = 0;
+	stats->snaps = 0;
+
+	stackPushBool(qtrue);
+}
+
+void gsc_player_getlastcmdtime(scr_entref_t id)
+{
+	if (id >= MAX_CLIENTS)
+	{
+		stackError("gsc_player_getlastcmdtime() entity %i is not a player", id);
+		stackPushUndefined();
+		return;
+	}
+
+	client_t *client = &svs.clients[id];
+
+	stackPushInt(client->lastUsercmd.serverTime);
+}
+
 void gsc_player_isbot(scr_entref_t id)
 {
 	if (id >= MAX_CLIENTS)
@@ -909,4 +1363,272 @@ void gsc_player_getcurrentoffhandslotammo(scr_entref_t id)
 	stackPushInt(ps->ammoclip[ps->offHandIndex - 1]);
 }
 
+/*
+	Finds where a player was at serverTime, interpolating between the two frames around it.
+	Times newer than the last frame use the last frame, older ones the oldest frame kept.
+*/
+static bool player_lagcomp_sample(lagcomphistory_t *history, int time, lagcompsample_t *out)
+{
+	unsigned int available = history->count < LAGCOMP_HISTORY ? history->count : LAGCOMP_HISTORY;
+
+	if (available == 0)
+		return false;
+
+	lagcompsample_t *newer = &history->samples[(history->count - 1) % LAGCOMP_HISTORY];
+
+	if (time >= newer->time)
+	{
+		*out = *newer;
+		return true;
+	}
+
+	for (unsigned int i = 2; i <= available; i++)
+	{
+		lagcompsample_t *older = &history->samples[(history->count - i) % LAGCOMP_HISTORY];
+
+		if (older->time <= time)
+		{
+			if (!older->playing || !newer->playing)
+			{
+				*out = older->time == time || !newer->playing ? *older : *newer;
+				return true;
+			}
+
+			float frac = (float)(time - older->time) / (newer->time - older->time);
+
+			*out = *older;
+
+			for (int j = 0; j < 3; j++)
+			{
+				out->origin[j] = older->origin[j] + frac * (newer->origin[j] - older->origin[j]);
+				out->mins[j] = older->mins[j] + frac * (newer->mins[j] - older->mins[j]);
+				out->maxs[j] = older->maxs[j] + frac * (newer->maxs[j] - older->maxs[j]);
+			}
+
+			// angles are close together between frames, wrap the short way round
+			for (int j = 0; j < 3; j++)
+			{
+				float delta = newer->angles[j] - older->angles[j];
+
+				if (delta > 180)
+					delta -= 360;
+				else if (delta < -180)
+					delta += 360;
+
+				out->angles[j] = older->angles[j] + frac * delta;
+			}
+
+			return true;
+		}
+
+		newer = older;
+	}
+
+	*out = *newer;
+	return true;
+}
+
+/*
+	lagcompensatedtrace(start, end, passEntityNum, serverTime[, contentmask]) moves every
+	playing client back to where it was at serverTime (see getlastcmdtime), runs
+	G_LocationalTrace and puts them back. Returns [fraction, position, entity, normal].
+*/
+void gsc_players_lagcompensatedtrace()
+{
+	vec3_t start;
+	vec3_t end;
+	int passEntityNum;
+	int serverTime;
+	int contentmask = MASK_SHOT;
+
+	if ( ! stackGetParams("vvii", &start, &end, &passEntityNum, &serverTime))
+	{
+		stackError("gsc_players_lagcompensatedtrace() one or more arguments is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	if (Scr_GetNumParam() > 4 && !stackGetParamInt(4, &contentmask))
+	{
+		stackError("gsc_players_lagcompensatedtrace() argument contentmask has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	extern lagcomphistory_t lagcomphistory[MAX_CLIENTS];
+	lagcompsample_t saved[MAX_CLIENTS];
+	bool moved[MAX_CLIENTS];
+
+	for (int i = 0; i < MAX_CLIENTS; i++)
+	{
+		gentity_t *ent = &g_entities[i];
+		moved[i] = false;
+
+		if (i == passEntityNum || svs.clients[i].state != CS_ACTIVE || ent->client == NULL || ent->client->sess.state != STATE_PLAYING || !ent->r.linked)
+			continue;
+
+		lagcompsample_t sample;
+
+		if (!player_lagcomp_sample(&lagcomphistory[i], serverTime, &sample))
+			continue;
+
+		VectorCopy(ent->r.currentOrigin, saved[i].origin);
+		VectorCopy(ent->r.currentAngles, saved[i].angles);
+		VectorCopy(ent->r.mins, saved[i].mins);
+		VectorCopy(ent->r.maxs, saved[i].maxs);
+		saved[i].eFlags = ent->s.eFlags;
+		moved[i] = true;
+
+		if (!sample.playing)
+		{
+			SV_UnlinkEntity(ent); // not alive back then, nothing to hit
+			continue;
+		}
+
+		VectorCopy(sample.origin, ent->r.currentOrigin);
+		VectorCopy(sample.angles, ent->r.currentAngles);
+		VectorCopy(sample.mins, ent->r.mins);
+		VectorCopy(sample.maxs, ent->r.maxs);
+		ent->s.eFlags = sample.eFlags;
+		SV_LinkEntity(ent);
+	}
+
+	trace_t trace;
+	G_LocationalTrace(&trace, start, end, passEntityNum, contentmask);
+
+	for (int i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (!moved[i])
+			continue;
+
+		gentity_t *ent = &g_entities[i];
+
+		VectorCopy(saved[i].origin, ent->r.currentOrigin);
+		VectorCopy(saved[i].angles, ent->r.currentAngles);
+		VectorCopy(saved[i].mins, ent->r.mins);
+		VectorCopy(saved[i].maxs, ent->r.maxs);
+		ent->s.eFlags = saved[i].eFlags;
+		SV_LinkEntity(ent);
+	}
+
+	vec3_t position;
+	VectorSet(position, start[0] + trace.fraction * (end[0] - start[0]), start[1] + trace.fraction * (end[1] - start[1]), start[2] + trace.fraction * (end[2] - start[2]));
+
+	stackPushArray();
+
+	stackPushFloat(trace.fraction);
+	stackPushArrayLast();
+
+	stackPushVector(position);
+	stackPushArrayLast();
+
+	if (trace.entityNum < ENTITYNUM_WORLD)
+		stackPushEntity(&g_entities[trace.entityNum]);
+	else
+		stackPushUndefined();
+	stackPushArrayLast();
+
+	stackPushVector(trace.normal);
+	stackPushArrayLast();
+}
+
+/*
+	registerplayercommand(name[, burst, period]) routes a client command to
+	CodeCallback_PlayerCommand. Once any command is registered, unregistered ones go
+	straight to the game without touching the VM. A client sending more than burst
+	commands per period milliseconds has the excess dropped.
+*/
+void gsc_players_registercommand()
+{
+	char *name;
+	int burst = 0;
+	int period = 1000;
+
+	if ( ! stackGetParams("s", &name))
+	{
+		stackError("gsc_players_registercommand() argument is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	if (Scr_GetNumParam() > 1 && ( ! stackGetParamInt(1, &burst) || ! stackGetParamInt(2, &period)))
+	{
+		stackError("gsc_players_registercommand() burst and period must be integers");
+		stackPushUndefined();
+		return;
+	}
+
+	if (strlen(name) >= sizeof(((playercommand_t *)0)->name) || burst < 0 || period < 1)
+	{
+		stackError("gsc_players_registercommand() invalid command %s", name);
+		stackPushUndefined();
+		return;
+	}
+
+	extern playercommand_t playercommands[MAX_PLAYERCOMMANDS];
+	extern int playercommands_count;
+	extern playercommandlimit_t playercommandlimits[MAX_CLIENTS];
+	int SV_FindPlayerCommand(const char *name);
+	unsigned int SV_PlayerCommandHash(const char *name);
+
+	int index = SV_FindPlayerCommand(name);
+
+	if (index == -1)
+	{
+		if (playercommands_count == MAX_PLAYERCOMMANDS)
+		{
+			stackError("gsc_players_registercommand() more than %i commands", MAX_PLAYERCOMMANDS);
+			stackPushUndefined();
+			return;
+		}
+
+		index = playercommands_count++;
+		strcpy(playercommands[index].name, name);
+		playercommands[index].hash = SV_PlayerCommandHash(name);
+
+		for (int i = 0; i < MAX_CLIENTS; i++)
+			memset(&playercommandlimits[i].commands[index], 0, sizeof(playercommandbucket_t));
+	}
+
+	playercommands[index].burst = burst;
+	playercommands[index].period = period;
+
+	stackPushBool(qtrue);
+}
+
+void gsc_players_unregistercommand()
+{
+	char *name;
+
+	if ( ! stackGetParams("s", &name))
+	{
+		stackError("gsc_players_unregistercommand() argument is undefined or has a wrong type");
+		stackPushUndefined();
+		return;
+	}
+
+	extern playercommand_t playercommands[MAX_PLAYERCOMMANDS];
+	extern int playercommands_count;
+	extern playercommandlimit_t playercommandlimits[MAX_CLIENTS];
+	int SV_FindPlayerCommand(const char *name);
+
+	int index = SV_FindPlayerCommand(name);
+
+	if (index == -1)
+	{
+		stackPushBool(qfalse);
+		return;
+	}
+
+	// Move the last command into the hole, its buckets move along
+	int last = --playercommands_count;
+
+	playercommands[index] = playercommands[last];
+
+	for (int i = 0; i < MAX_CLIENTS; i++)
+		playercommandlimits[i].commands[index] = playercommandlimits[i].commands[last];
+
+	stackPushBool(qtrue);
+}
+
 #endif
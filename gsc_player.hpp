@@ -4,6 +4,114 @@
 /* gsc functions */
 #include "gsc.hpp"
 
+#define CMDSTATS_HISTORY 10
+#define CMDSTATS_SMOOTHING 16
+
+typedef struct
+{
+	int connectTime;
+	int lastServerTime;
+	int windowStart;
+	int windowCommands;
+	int fpsHistory[CMDSTATS_HISTORY]; // last full one second windows
+	int fpsHistoryCount;
+	float intervalMean;
+	float intervalJitter;
+	int drift; // svs.time - ucmd->serverTime
+	float driftMean;
+} clientcmdstats_t;
+
+#define SHORT2ANGLE(x) ((x) * (360.0 / 65536))
+
+#define AIMSTATS_SNAPS 16 // recent snap times kept per client
+#define AIMSTATS_WINDOW 60000
+#define AIMSTATS_CALLBACK_MSEC 1000
+
+typedef struct
+{
+	int connectTime;
+	int lastServerTime;
+	int lastAngles[2];
+	float lastVelocity;
+	float lastDelta;
+	float maxDelta; // degrees per command
+	float maxVelocity; // degrees per second
+	float maxAcceleration; // degrees per second squared
+	int snaps;
+	int snapTimes[AIMSTATS_SNAPS];
+	int lastCallbackTime;
+} aimstats_t;
+
+#define USERCMD_HISTORY 512 // power of two, a few seconds of commands at common client fps
+
+typedef struct
+{
+	int connectTime;
+	unsigned int count; // total commands recorded, head is count % USERCMD_HISTORY
+	usercmd_t cmds[USERCMD_HISTORY];
+} usercmdhistory_t;
+
+#define LAGCOMP_HISTORY 64 // server frames, a bit over 3 seconds at sv_fps 20
+
+typedef struct
+{
+	int time;
+	qboolean playing;
+	vec3_t origin;
+	vec3_t angles;
+	vec3_t mins, maxs;
+	int eFlags; // stance
+} lagcompsample_t;
+
+typedef struct
+{
+	int connectTime;
+	unsigned int count; // total samples recorded, head is count % LAGCOMP_HISTORY
+	lagcompsample_t samples[LAGCOMP_HISTORY];
+} lagcomphistory_t;
+
+#define USERINFO_KEYS 64
+#define USERINFO_SLOTS 128 // power of two, twice the keys
+#define USERINFO_CHANGED 16
+
+typedef struct
+{
+	int connectTime;
+	qboolean valid;
+	qboolean overflow; // more keys than USERINFO_KEYS, misses fall back to Info_ValueForKey
+	char buffer[1024]; // userinfo with the separators replaced by terminators
+	int numKeys;
+	short keys[USERINFO_KEYS]; // offsets into buffer
+	short values[USERINFO_KEYS];
+	unsigned char slots[USERINFO_SLOTS]; // key index + 1, 0 = empty
+	qboolean pending;
+	int numChanged;
+	char changed[USERINFO_CHANGED][32];
+} userinfocache_t;
+
+#define MAX_PLAYERCOMMANDS 64
+
+typedef struct
+{
+	char name[32];
+	unsigned int hash;
+	int burst; // 0 = no limit
+	int period;
+} playercommand_t;
+
+typedef struct
+{
+	int lastTime;
+	int burst;
+} playercommandbucket_t;
+
+typedef struct
+{
+	int connectTime;
+	playercommandbucket_t total;
+	playercommandbucket_t commands[MAX_PLAYERCOMMANDS];
+} playercommandlimit_t;
+
 void gsc_player_velocity_set(scr_entref_t id);
 void gsc_player_velocity_add(scr_entref_t id);
 void gsc_player_velocity_get(scr_entref_t id);
@@ -18,6 +126,8 @@ void gsc_player_button_jump(scr_entref_t id);
 void gsc_player_button_reload(scr_entref_t id);
 void gsc_player_button_frag(scr_entref_t id);
 void gsc_player_button_smoke(scr_entref_t id);
+void gsc_player_getbuttons(scr_entref_t id);
+void gsc_player_getinput(scr_entref_t id);
 void gsc_player_stance_get(scr_entref_t id);
 void gsc_player_stance_set(scr_entref_t id);
 void gsc_player_spectatorclient_get(scr_entref_t id);
@@ -47,6 +157,12 @@ void gsc_player_setguid(scr_entref_t id);
 void gsc_player_clienthasclientmuted(scr_entref_t id);
 void gsc_player_getlastgamestatesize(scr_entref_t id);
 void gsc_player_getfps(scr_entref_t id);
+void gsc_player_getcmdstats(scr_entref_t id);
+void gsc_player_getangularvelocity(scr_entref_t id);
+void gsc_player_getbuttonintervals(scr_entref_t id);
+void gsc_player_getaimstats(scr_entref_t id);
+void gsc_player_resetaimstats(scr_entref_t id);
+void gsc_player_getlastcmdtime(scr_entref_t id);
 void gsc_player_isbot(scr_entref_t id);
 void gsc_player_disableitempickup(scr_entref_t id);
 void gsc_player_enableitempickup(scr_entref_t id);
@@ -54,5 +170,10 @@ void gsc_player_getcurrentoffhandslotammo(scr_entref_t id);
 
 // player functions without entity
 void gsc_kick_slot();
+void gsc_players_getinput();
+void gsc_players_getstate();
+void gsc_players_lagcompensatedtrace();
+void gsc_players_registercommand();
+void gsc_players_unregistercommand();
 
 #endif
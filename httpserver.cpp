@@ -0,0 +1,622 @@
+#include "httpserver.hpp"
+
+// wwwDownload redirects do not exist in 1.0
+#if COMPILE_HTTPSERVER == 1 && (COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3)
+
+#include <pthread.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/*
+	Minimal HTTP/1.1 file server for the 1.2/1.3 wwwDownload redirect. It runs on its own
+	thread around one epoll set, file bodies go out with sendfile and never pass through
+	user space. Only "/<fs_game>/<name>.iwd" is served, looked up in fs_homepath, fs_basepath
+	and the manymaps Library. The thread never calls into the engine, the game thread hands
+	it the directories under a mutex and polls the cvars in HTTP_Frame.
+*/
+typedef enum
+{
+	HTTP_FREE,
+	HTTP_READING,
+	HTTP_HEADER,
+	HTTP_BODY
+} httpstate_t;
+
+typedef struct
+{
+	httpstate_t state;
+	int socket;
+	unsigned int address;
+	int file;
+	off_t offset;
+	off_t end;
+	char buffer[HTTP_REQUEST_SIZE]; // the request, then the response header
+	int length;
+	int sent;
+	time_t lastActive;
+} httpconnection_t;
+
+typedef struct
+{
+	char game[MAX_OSPATH];
+	char roots[3][MAX_OSPATH];
+} httproots_t;
+
+#define HTTP_TAG_LISTEN 0xFFFFFFFF
+#define HTTP_TAG_WAKE 0xFFFFFFFE
+
+static httpconnection_t httpConnections[HTTP_MAX_CONNECTIONS];
+static httproots_t httpRoots;
+static pthread_mutex_t httpRootsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t httpThread;
+static int httpListen = -1;
+static int httpEpoll = -1;
+static int httpWake = -1;
+static int httpPort = 0;
+static volatile bool httpRunning = false;
+
+// Written by the server thread only, read for http_status. A 64 bit counter can tear
+// on 32 bit, httpBytes is only touched under its mutex.
+static volatile unsigned int httpServed = 0;
+static volatile unsigned int httpRejected = 0;
+static unsigned long long httpBytes = 0;
+static pthread_mutex_t httpBytesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void HTTP_Close(httpconnection_t *c)
+{
+	close(c->socket);
+
+	if (c->file != -1)
+		close(c->file);
+
+	c->state = HTTP_FREE;
+}
+
+static void HTTP_Watch(httpconnection_t *c, unsigned int events)
+{
+	struct epoll_event event;
+
+	event.events = events;
+	event.data.u32 = c - httpConnections;
+
+	epoll_ctl(httpEpoll, EPOLL_CTL_MOD, c->socket, &event);
+}
+
+static void HTTP_Accept()
+{
+	for (;;)
+	{
+		struct sockaddr_in from;
+		socklen_t length = sizeof(from);
+		int s = accept4(httpListen, (struct sockaddr *)&from, &length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+		if (s == -1)
+			return;
+
+		httpconnection_t *slot = NULL;
+		int fromAddress = 0;
+
+		for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+		{
+			httpconnection_t *c = &httpConnections[i];
+
+			if (c->state == HTTP_FREE)
+			{
+				if (slot == NULL)
+					slot = c;
+			}
+			else if (c->address == from.sin_addr.s_addr)
+			{
+				fromAddress++;
+			}
+		}
+
+		if (slot == NULL || fromAddress >= HTTP_MAX_PER_ADDRESS)
+		{
+			httpRejected++;
+			close(s);
+			continue;
+		}
+
+		slot->state = HTTP_READING;
+		slot->socket = s;
+		slot->address = from.sin_addr.s_addr;
+		slot->file = -1;
+		slot->length = 0;
+		slot->sent = 0;
+		slot->lastActive = time(NULL);
+
+		struct epoll_event event;
+
+		event.events = EPOLLIN;
+		event.data.u32 = slot - httpConnections;
+
+		if (epoll_ctl(httpEpoll, EPOLL_CTL_ADD, s, &event) == -1)
+			HTTP_Close(slot);
+	}
+}
+
+// Opens "/<game>/<name>.iwd", anything else is not found
+static int HTTP_OpenFile(const char *path, off_t *size)
+{
+	httproots_t roots;
+
+	pthread_mutex_lock(&httpRootsMutex);
+	roots = httpRoots;
+	pthread_mutex_unlock(&httpRootsMutex);
+
+	int gameLength = strlen(roots.game);
+
+	if (path[0] != '/' || gameLength == 0 || strncmp(path + 1, roots.game, gameLength) != 0 || path[gameLength + 1] != '/')
+		return -1;
+
+	const char *name = path + gameLength + 2;
+	int nameLength = strlen(name);
+
+	if (nameLength <= 4 || name[0] == '.' || strpbrk(name, "/\\%") != NULL || strcasecmp(name + nameLength - 4, ".iwd") != 0)
+		return -1;
+
+	for (unsigned int i = 0; i < sizeof(roots.roots) / sizeof(roots.roots[0]); i++)
+	{
+		char filename[MAX_OSPATH * 2];
+		struct stat st;
+
+		if (roots.roots[i][0] == '\0')
+			continue;
+
+		snprintf(filename, sizeof(filename), "%s/%s", roots.roots[i], name);
+
+		int file = open(filename, O_RDONLY | O_CLOEXEC);
+
+		if (file == -1)
+			continue;
+
+		if (fstat(file, &st) == 0 && S_ISREG(st.st_mode))
+		{
+			*size = st.st_size;
+			return file;
+		}
+
+		close(file);
+	}
+
+	return -1;
+}
+
+static void HTTP_Error(httpconnection_t *c, int status, const char *reason)
+{
+	c->length = snprintf(c->buffer, sizeof(c->buffer),
+	                     "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status, reason);
+	c->sent = 0;
+	c->offset = c->end = 0;
+	c->state = HTTP_HEADER;
+}
+
+static void HTTP_Request(httpconnection_t *c)
+{
+	char method[8];
+	char path[MAX_OSPATH];
+
+	if (sscanf(c->buffer, "%7s %255s HTTP/1.", method, path) != 2)
+	{
+		HTTP_Error(c, 400, "Bad Request");
+		return;
+	}
+
+	bool head = strcmp(method, "HEAD") == 0;
+
+	if ( ! head && strcmp(method, "GET") != 0)
+	{
+		HTTP_Error(c, 405, "Method Not Allowed");
+		return;
+	}
+
+	char *query = strchr(path, '?');
+
+	if (query != NULL)
+		*query = '\0';
+
+	off_t size;
+	int file = HTTP_OpenFile(path, &size);
+
+	if (file == -1)
+	{
+		HTTP_Error(c, 404, "Not Found");
+		return;
+	}
+
+	// A single "bytes=first-[last]" range, so interrupted downloads can resume
+	off_t first = 0, last = size - 1;
+	bool partial = false;
+	const char *range = strcasestr(c->buffer, "\r\nRange: bytes=");
+
+	if (range != NULL)
+	{
+		long long a, b;
+		int fields = sscanf(range + strlen("\r\nRange: bytes="), "%lld-%lld", &a, &b);
+
+		if (fields >= 1 && a >= 0)
+		{
+			if (a >= size)
+			{
+				close(file);
+				HTTP_Error(c, 416, "Range Not Satisfiable");
+				return;
+			}
+
+			first = a;
+
+			if (fields == 2 && b >= a && b < size)
+				last = b;
+
+			partial = true;
+		}
+	}
+
+	c->file = file;
+	c->offset = first;
+	c->end = head ? first : last + 1;
+	c->sent = 0;
+	c->state = HTTP_HEADER;
+
+	if (partial)
+		c->length = snprintf(c->buffer, sizeof(c->buffer),
+		                     "HTTP/1.1 206 Partial Content\r\nContent-Type: application/octet-stream\r\nContent-Length: %lld\r\n"
+		                     "Content-Range: bytes %lld-%lld/%lld\r\nAccept-Ranges: bytes\r\nConnection: close\r\n\r\n",
+		                     (long long)(last + 1 - first), (long long)first, (long long)last, (long long)size);
+	else
+		c->length = snprintf(c->buffer, sizeof(c->buffer),
+		                     "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: %lld\r\n"
+		                     "Accept-Ranges: bytes\r\nConnection: close\r\n\r\n", (long long)size);
+
+	httpServed++;
+}
+
+static void HTTP_Write(httpconnection_t *c)
+{
+	if (c->state == HTTP_HEADER)
+	{
+		while (c->sent < c->length)
+		{
+			int n = send(c->socket, c->buffer + c->sent, c->length - c->sent, MSG_NOSIGNAL);
+
+			if (n == -1)
+			{
+				if (errno != EAGAIN && errno != EWOULDBLOCK)
+					HTTP_Close(c);
+
+				return;
+			}
+
+			c->sent += n;
+		}
+
+		c->state = HTTP_BODY;
+	}
+
+	while (c->offset < c->end)
+	{
+		off_t left = c->end - c->offset;
+		ssize_t n = sendfile(c->socket, c->file, &c->offset, left < HTTP_SENDFILE_CHUNK ? left : HTTP_SENDFILE_CHUNK);
+
+		if (n <= 0)
+		{
+			if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				return;
+
+			HTTP_Close(c);
+			return;
+		}
+
+		pthread_mutex_lock(&httpBytesMutex);
+		httpBytes += n;
+		pthread_mutex_unlock(&httpBytesMutex);
+	}
+
+	HTTP_Close(c);
+}
+
+static void HTTP_Read(httpconnection_t *c)
+{
+	for (;;)
+	{
+		int n = recv(c->socket, c->buffer + c->length, sizeof(c->buffer) - 1 - c->length, 0);
+
+		if (n == 0 || (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK))
+		{
+			HTTP_Close(c);
+			return;
+		}
+
+		if (n == -1)
+			return;
+
+		c->length += n;
+		c->buffer[c->length] = '\0';
+
+		if (strstr(c->buffer, "\r\n\r\n") != NULL)
+			break;
+
+		if (c->length == sizeof(c->buffer) - 1)
+		{
+			HTTP_Error(c, 431, "Request Header Fields Too Large");
+			break;
+		}
+	}
+
+	if (c->state == HTTP_READING)
+		HTTP_Request(c);
+
+	HTTP_Watch(c, EPOLLOUT);
+	HTTP_Write(c);
+}
+
+static void *HTTP_Thread(void *arg)
+{
+	struct epoll_event events[64];
+
+	while (httpRunning)
+	{
+		int n = epoll_wait(httpEpoll, events, sizeof(events) / sizeof(events[0]), 1000);
+
+		for (int i = 0; i < n; i++)
+		{
+			unsigned int tag = events[i].data.u32;
+
+			if (tag == HTTP_TAG_LISTEN)
+			{
+				HTTP_Accept();
+				continue;
+			}
+
+			if (tag == HTTP_TAG_WAKE)
+			{
+				eventfd_t value;
+				eventfd_read(httpWake, &value);
+				continue;
+			}
+
+			httpconnection_t *c = &httpConnections[tag];
+
+			if (c->state == HTTP_FREE)
+				continue;
+
+			c->lastActive = time(NULL);
+
+			if (events[i].events & (EPOLLERR | EPOLLHUP))
+				HTTP_Close(c);
+			else if (c->state == HTTP_READING)
+				HTTP_Read(c);
+			else
+				HTTP_Write(c);
+		}
+
+		time_t now = time(NULL);
+
+		for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+		{
+			if (httpConnections[i].state != HTTP_FREE && now - httpConnections[i].lastActive > HTTP_IDLE_TIMEOUT)
+				HTTP_Close(&httpConnections[i]);
+		}
+	}
+
+	for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+	{
+		if (httpConnections[i].state != HTTP_FREE)
+			HTTP_Close(&httpConnections[i]);
+	}
+
+	return NULL;
+}
+
+bool HTTP_Start(int port)
+{
+	struct sockaddr_in address;
+	struct epoll_event event;
+	int yes = 1;
+
+	if (httpRunning)
+		return true;
+
+	httpListen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (httpListen == -1)
+		return false;
+
+	setsockopt(httpListen, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+	if (bind(httpListen, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(httpListen, 64) == -1)
+	{
+		Com_Printf("http: could not listen on port %d: %s\n", port, strerror(errno));
+		close(httpListen);
+		httpListen = -1;
+		return false;
+	}
+
+	httpEpoll = epoll_create1(EPOLL_CLOEXEC);
+	httpWake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	event.events = EPOLLIN;
+	event.data.u32 = HTTP_TAG_LISTEN;
+	epoll_ctl(httpEpoll, EPOLL_CTL_ADD, httpListen, &event);
+
+	event.events = EPOLLIN;
+	event.data.u32 = HTTP_TAG_WAKE;
+	epoll_ctl(httpEpoll, EPOLL_CTL_ADD, httpWake, &event);
+
+	for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+		httpConnections[i].state = HTTP_FREE;
+
+	httpRunning = true;
+
+	if (pthread_create(&httpThread, NULL, HTTP_Thread, NULL) != 0)
+	{
+		httpRunning = false;
+		close(httpWake);
+		close(httpEpoll);
+		close(httpListen);
+		httpListen = -1;
+		return false;
+	}
+
+	httpPort = port;
+	Com_Printf("http: serving downloads on port %d\n", port);
+
+	return true;
+}
+
+void HTTP_Stop()
+{
+	if ( ! httpRunning)
+		return;
+
+	httpRunning = false;
+	eventfd_write(httpWake, 1);
+	pthread_join(httpThread, NULL);
+
+	close(httpWake);
+	close(httpEpoll);
+	close(httpListen);
+	httpListen = -1;
+
+	Com_Printf("http: stopped\n");
+}
+
+void HTTP_SetRoots(const char *homepath, const char *basepath, const char *game, const char *library)
+{
+	pthread_mutex_lock(&httpRootsMutex);
+
+	snprintf(httpRoots.game, sizeof(httpRoots.game), "%s", game);
+	snprintf(httpRoots.roots[0], sizeof(httpRoots.roots[0]), "%s/%s", homepath, game);
+	snprintf(httpRoots.roots[1], sizeof(httpRoots.roots[1]), "%s/%s", basepath, game);
+	snprintf(httpRoots.roots[2], sizeof(httpRoots.roots[2]), "%s", library);
+
+	pthread_mutex_unlock(&httpRootsMutex);
+}
+
+/*
+	Called once per frame on the game thread, checks the cvars at most once a second.
+	Starts or stops the server, keeps the served directories on the current fs_game and
+	fs_library and points sv_wwwBaseURL at the server.
+*/
+void HTTP_Frame()
+{
+	extern cvar_t *sv_httpServer;
+	extern cvar_t *sv_httpPort;
+	extern cvar_t *sv_httpHost;
+	extern cvar_t *fs_library;
+	static int lastCheck = 0;
+	static int failedPort = 0;
+	static char game[MAX_OSPATH];
+	static char library[MAX_OSPATH];
+
+	int now = Sys_MilliSeconds();
+
+	if (now - lastCheck < 1000 && now >= lastCheck)
+		return;
+
+	lastCheck = now;
+
+	cvar_t *net_port = Cvar_FindVar("net_port");
+	int port = sv_httpPort->floatval > 0 ? (int)sv_httpPort->floatval : (net_port ? net_port->integer : 0);
+
+	if (httpRunning && ( ! sv_httpServer->boolean || port != httpPort))
+		HTTP_Stop();
+
+	if ( ! sv_httpServer->boolean)
+	{
+		failedPort = 0;
+		return;
+	}
+
+	if ( ! httpRunning)
+	{
+		if (port == failedPort)
+			return; // retried once the port changes or the server is toggled
+
+		if ( ! HTTP_Start(port))
+		{
+			failedPort = port;
+			return;
+		}
+
+		failedPort = 0;
+		game[0] = '\0';
+	}
+
+	cvar_t *fs_game = Cvar_FindVar("fs_game");
+	cvar_t *fs_homepath = Cvar_FindVar("fs_homepath");
+	cvar_t *fs_basepath = Cvar_FindVar("fs_basepath");
+
+	if (fs_game && fs_homepath && fs_basepath)
+	{
+		// Same Library as the manymaps lookup in libcod.cpp
+		char path[MAX_OSPATH];
+
+		if (strlen(fs_library->string))
+			snprintf(path, sizeof(path), "%s", fs_library->string);
+		else
+			snprintf(path, sizeof(path), "%s/%s/Library", fs_homepath->string, fs_game->string);
+
+		if (strcmp(game, fs_game->string) != 0 || strcmp(library, path) != 0)
+		{
+			snprintf(game, sizeof(game), "%s", fs_game->string);
+			snprintf(library, sizeof(library), "%s", path);
+			HTTP_SetRoots(fs_homepath->string, fs_basepath->string, game, library);
+		}
+	}
+
+	const char *host = sv_httpHost->string;
+
+	if (*host == '\0')
+	{
+		cvar_t *net_ip = Cvar_FindVar("net_ip");
+
+		host = net_ip ? net_ip->string : "";
+	}
+
+	if (*host == '\0' || strcmp(host, "localhost") == 0 || strcmp(host, "0.0.0.0") == 0)
+		return; // no public address known, set sv_httpHost
+
+	cvar_t *sv_wwwBaseURL = Cvar_FindVar("sv_wwwBaseURL");
+	char url[MAX_OSPATH];
+
+	snprintf(url, sizeof(url), "http://%s:%d", host, httpPort);
+
+	if (sv_wwwBaseURL && strcmp(sv_wwwBaseURL->string, url) != 0)
+		Cvar_SetString(sv_wwwBaseURL, url);
+}
+
+void HTTP_Status_f()
+{
+	int open = 0;
+
+	for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+	{
+		if (httpConnections[i].state != HTTP_FREE)
+			open++;
+	}
+
+	if ( ! httpRunning)
+	{
+		Com_Printf("http: not running\n");
+		return;
+	}
+
+	pthread_mutex_lock(&httpBytesMutex);
+	unsigned long long bytes = httpBytes;
+	pthread_mutex_unlock(&httpBytesMutex);
+
+	Com_Printf("http: port %d, %d connections, %u files served, %llu bytes sent, %u connections rejected\n", httpPort, open, httpServed, bytes, httpRejected);
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef _HTTPSERVER_HPP_
+#define _HTTPSERVER_HPP_
+
+#include "gsc.hpp"
+
+#define HTTP_MAX_CONNECTIONS 256
+#define HTTP_MAX_PER_ADDRESS 4
+#define HTTP_REQUEST_SIZE 2048
+#define HTTP_IDLE_TIMEOUT 30 // seconds without progress before a connection is dropped
+#define HTTP_SENDFILE_CHUNK (256 * 1024)
+
+bool HTTP_Start(int port);
+void HTTP_Stop();
+void HTTP_SetRoots(const char *homepath, const char *basepath, const char *game, const char *library);
+void HTTP_Frame();
+void HTTP_Status_f();
+
+#endif
@@ -14,6 +14,9 @@ cvar_t *dedicated;
 #if COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3
 cvar_t *sv_wwwDownload;
 cvar_t *cl_wwwDownload;
+cvar_t *sv_httpServer;
+cvar_t *sv_httpPort;
+cvar_t *sv_httpHost;
 #endif
 
 cvar_t *sv_cracked;
@@ -23,11 +26,32 @@ cvar_t *g_playerEject;
 cvar_t *sv_allowRcon;
 cvar_t *fs_library;
 cvar_t *sv_downloadMessage;
+cvar_t *sv_hookProfile = NULL;
+cvar_t *sv_aimSnapSpeed;
+cvar_t *sv_aimSnapAngle;
+cvar_t *sv_aimSnapFlagCount;
+cvar_t *sv_playerCommandBurst;
+cvar_t *sv_playerCommandPeriod;
+cvar_t *sv_chatFilter;
+cvar_t *sv_chatFilterFile;
+cvar_t *sv_banFile;
+cvar_t *sv_downloadCache;
+cvar_t *sv_downloadBandwidth;
+cvar_t *sv_downloadMaxRate;
+cvar_t *sv_downloadPriority;
+cvar_t *sv_downloadResumeTime;
 
 #define MAX_MASTER_SERVERS 5
 #define PORT_MASTER 20710
 cvar_t *sv_master[MAX_MASTER_SERVERS];
 
+#if COMPILE_RATELIMITER == 1
+void SVC_RegisterRateLimits( void );
+void SVC_RateLimitStats( void );
+void SVC_BenchmarkRateLimit( void );
+void SVC_StatusCached( netadr_t from );
+#endif
+
 void hook_sv_init(const char *format, ...)
 {
 	char s[COD2_MAX_STRINGLENGTH];
@@ -50,6 +74,26 @@ void hook_sv_init(const char *format, ...)
 	sv_allowRcon = Cvar_RegisterBool("sv_allowRcon", qtrue, CVAR_ARCHIVE);
 	fs_library = Cvar_RegisterString("fs_library", "", CVAR_ARCHIVE);
 	sv_downloadMessage = Cvar_RegisterString("sv_downloadMessage", "", CVAR_ARCHIVE);
+	sv_downloadCache = Cvar_RegisterBool("sv_downloadCache", qtrue, CVAR_ARCHIVE);
+	sv_downloadBandwidth = Cvar_RegisterFloat("sv_downloadBandwidth", 0.0, 0.0, 100000000.0, CVAR_ARCHIVE); // bytes/s shared by all downloads, 0 = no cap
+	sv_downloadMaxRate = Cvar_RegisterFloat("sv_downloadMaxRate", 25000.0, 1000.0, 10000000.0, CVAR_ARCHIVE);
+	sv_downloadPriority = Cvar_RegisterFloat("sv_downloadPriority", 2.0, 1.0, 100.0, CVAR_ARCHIVE); // share weight of players kept over a map change
+	sv_downloadResumeTime = Cvar_RegisterFloat("sv_downloadResumeTime", 120.0, 0.0, 3600.0, CVAR_ARCHIVE); // seconds an interrupted download is remembered, 0 = off
+	sv_hookProfile = Cvar_RegisterBool("sv_hookProfile", qfalse, CVAR_ARCHIVE);
+#if COMPILE_PLAYER == 1
+	sv_aimSnapSpeed = Cvar_RegisterFloat("sv_aimSnapSpeed", 1500.0, 100.0, 100000.0, CVAR_ARCHIVE);
+	sv_aimSnapAngle = Cvar_RegisterFloat("sv_aimSnapAngle", 1.0, 0.0, 10.0, CVAR_ARCHIVE);
+	sv_aimSnapFlagCount = Cvar_RegisterFloat("sv_aimSnapFlagCount", 5.0, 1.0, AIMSTATS_SNAPS, CVAR_ARCHIVE);
+#endif
+	sv_playerCommandBurst = Cvar_RegisterFloat("sv_playerCommandBurst", 0.0, 0.0, 1000.0, CVAR_ARCHIVE);
+	sv_playerCommandPeriod = Cvar_RegisterFloat("sv_playerCommandPeriod", 1000.0, 1.0, 60000.0, CVAR_ARCHIVE);
+	sv_chatFilter = Cvar_RegisterFloat("sv_chatFilter", 1.0, 0.0, 2.0, CVAR_ARCHIVE); // 0 = off, 1 = mask matches, 2 = drop message
+	sv_chatFilterFile = Cvar_RegisterString("sv_chatFilterFile", "chatfilter.txt", CVAR_ARCHIVE);
+	sv_banFile = Cvar_RegisterString("sv_banFile", "bans.txt", CVAR_ARCHIVE);
+
+#if COMPILE_RATELIMITER == 1
+	SVC_RegisterRateLimits();
+#endif
 
 	sv_master[0] = Cvar_RegisterString("sv_master1", "cod2master.activision.com", CVAR_ARCHIVE);
 	sv_master[1] = Cvar_RegisterString("sv_master2", "master.cod2.ru", CVAR_ARCHIVE);
@@ -62,6 +106,11 @@ void hook_sv_init(const char *format, ...)
 
 #if COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3
 	cl_wwwDownload = Cvar_RegisterBool("cl_wwwDownload", qtrue, CVAR_ARCHIVE | CVAR_SYSTEMINFO);
+
+	// Embedded download server for wwwDownload redirects, the port defaults to net_port over TCP
+	sv_httpServer = Cvar_RegisterBool("sv_httpServer", qfalse, CVAR_ARCHIVE);
+	sv_httpPort = Cvar_RegisterFloat("sv_httpPort", 0.0, 0.0, 65535.0, CVAR_ARCHIVE);
+	sv_httpHost = Cvar_RegisterString("sv_httpHost", "", CVAR_ARCHIVE); // address put in sv_wwwBaseURL, defaults to net_ip
 #endif
 
 	sv_maxclients = Cvar_FindVar("sv_maxclients");
@@ -77,10 +126,39 @@ void hook_sv_init(const char *format, ...)
 	sv_wwwDownload = Cvar_FindVar("sv_wwwDownload");
 #endif
 
+	// Register custom commands
+	Cmd_AddCommand("hook_benchmark", cracking_benchmark_hooks);
+	Cmd_AddCommand("hook_profile", cracking_profile_dump);
+
+#if COMPILE_RATELIMITER == 1
+	Cmd_AddCommand("ratelimit_stats", SVC_RateLimitStats);
+	Cmd_AddCommand("ratelimit_benchmark", SVC_BenchmarkRateLimit);
+#endif
+
+#if COMPILE_BANS == 1
+	Cmd_AddCommand("ban_reload", Ban_Reload_f);
+
+	if (access(sv_banFile->string, F_OK) == 0)
+		Ban_Load(sv_banFile->string);
+#endif
+
+#if COMPILE_HTTPSERVER == 1 && (COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3)
+	Cmd_AddCommand("http_status", HTTP_Status_f);
+#endif
+
+#if COMPILE_CHATFILTER == 1
+	Cmd_AddCommand("chatfilter_reload", ChatFilter_Reload_f);
+
+	if (access(sv_chatFilterFile->string, F_OK) == 0)
+		ChatFilter_Load(sv_chatFilterFile->string);
+#endif
+
 }
 
 void hook_sv_spawnserver(const char *format, ...)
 {
+	HOOK_PROFILE(hook_sv_spawnserver);
+
 	char s[COD2_MAX_STRINGLENGTH];
 	va_list va;
 
@@ -102,6 +180,8 @@ void hook_sv_spawnserver(const char *format, ...)
 #define	STATUS_MSEC		600000
 void custom_SV_MasterHeartbeat(const char *game)
 {
+	HOOK_PROFILE(custom_SV_MasterHeartbeat);
+
 	static netadr_t	adr[MAX_MASTER_SERVERS];
 	char heartbeat[32];
 	int	i;
@@ -197,7 +277,11 @@ void custom_SV_MasterHeartbeat(const char *game)
 			}
 
 			if (strlen(sv_master[i]->string))
+#if COMPILE_RATELIMITER == 1
+				SVC_StatusCached(adr[i]);
+#else
 				SVC_Status(adr[i]);
+#endif
 		}
 	}
 }
@@ -212,11 +296,14 @@ int codecallback_vid_restart = 0;
 int codecallback_meleebutton = 0;
 int codecallback_usebutton = 0;
 int codecallback_attackbutton = 0;
+int codecallback_buttonevents = 0;
+int codecallback_aimsnap = 0;
+int codecallback_chatfilter = 0;
 
 cHook *hook_gametype_scripts;
 int hook_codscript_gametype_scripts()
 {
-	hook_gametype_scripts->unhook();
+	HOOK_PROFILE(hook_codscript_gametype_scripts);
 
 	codecallback_remotecommand = Scr_GetFunctionHandle("maps/mp/gametypes/_callbacksetup", "CodeCallback_RemoteCommand", 0);
 
@@ -228,11 +315,20 @@ int hook_codscript_gametype_scripts()
 	codecallback_meleebutton = Scr_GetFunctionHandle("maps/mp/gametypes/_callbacksetup", "CodeCallback_MeleeButton", 0);
 	codecallback_usebutton = Scr_GetFunctionHandle("maps/mp/gametypes/_callbacksetup", "CodeCallback_UseButton", 0);
 	codecallback_attackbutton = Scr_GetFunctionHandle("maps/mp/gametypes/_callbacksetup", "CodeCallback_AttackButton", 0);
+	codecallback_buttonevents = Scr_GetFunctionHandle("maps/mp/gametypes/_callbacksetup", "CodeCallback_ButtonEvents", 0);
+	codecallback_aimsnap = Scr_GetFunctionHandle("maps/mp/gametypes/_callbacksetup", "CodeCallback_AimSnap", 0);
+	codecallback_chatfilter = Scr_GetFunctionHandle("maps/mp/gametypes/_callbacksetup", "CodeCallback_ChatFilter", 0);
+
+#if COMPILE_PLAYER == 1
+	// Scripts register their commands again on every map
+	extern int playercommands_count;
+	playercommands_count = 0;
+#endif
 
 	int (*sig)();
-	*(int *)&sig = hook_gametype_scripts->from;
+	*(int *)&sig = hook_gametype_scripts->original();
 	int ret = sig();
-	hook_gametype_scripts->hook();
+	hook_gametype_scripts->rehook();
 
 	return ret;
 }
@@ -241,10 +337,10 @@ int player_disableitempickup[MAX_CLIENTS] = {0};
 cHook *hook_touch_item_auto;
 int touch_item_auto(gentity_t *ent, gentity_t *other, int touch)
 {
-	hook_touch_item_auto->unhook();
+	HOOK_PROFILE(touch_item_auto);
 
 	int (*sig)(gentity_t *ent, gentity_t *other, int touch);
-	*(int *)&sig = hook_touch_item_auto->from;
+	*(int *)&sig = hook_touch_item_auto->original();
 
 	int ret;
 
@@ -253,7 +349,7 @@ int touch_item_auto(gentity_t *ent, gentity_t *other, int touch)
 	else
 		ret = 0;
 
-	hook_touch_item_auto->hook();
+	hook_touch_item_auto->rehook();
 
 	return ret;
 }
@@ -261,10 +357,10 @@ int touch_item_auto(gentity_t *ent, gentity_t *other, int touch)
 cHook *hook_player_collision;
 int player_collision(int a1)
 {
-	hook_player_collision->unhook();
+	HOOK_PROFILE(player_collision);
 
 	int (*sig)(int a1);
-	*(int *)&sig = hook_player_collision->from;
+	*(int *)&sig = hook_player_collision->original();
 
 	int ret;
 
@@ -273,7 +369,7 @@ int player_collision(int a1)
 	else
 		ret = 0;
 
-	hook_player_collision->hook();
+	hook_player_collision->rehook();
 
 	return ret;
 }
@@ -281,10 +377,10 @@ int player_collision(int a1)
 cHook *hook_player_eject;
 int player_eject(int a1)
 {
-	hook_player_eject->unhook();
+	HOOK_PROFILE(player_eject);
 
 	int (*sig)(int a1);
-	*(int *)&sig = hook_player_eject->from;
+	*(int *)&sig = hook_player_eject->original();
 
 	int ret;
 
@@ -293,7 +389,7 @@ int player_eject(int a1)
 	else
 		ret = 0;
 
-	hook_player_eject->hook();
+	hook_player_eject->rehook();
 
 	return ret;
 }
@@ -301,14 +397,14 @@ int player_eject(int a1)
 cHook *hook_fire_grenade;
 gentity_t* fire_grenade(gentity_t *self, vec3_t start, vec3_t dir, int weapon, int time)
 {
-	hook_fire_grenade->unhook();
+	HOOK_PROFILE(fire_grenade);
 
 	gentity_t* (*sig)(gentity_t *self, vec3_t start, vec3_t dir, int weapon, int time);
-	*(int *)&sig = hook_fire_grenade->from;
+	*(int *)&sig = hook_fire_grenade->original();
 
 	gentity_t* grenade = sig(self, start, dir, weapon, time);
 
-	hook_fire_grenade->hook();
+	hook_fire_grenade->rehook();
 
 	if (codecallback_fire_grenade)
 	{
@@ -322,14 +418,121 @@ gentity_t* fire_grenade(gentity_t *self, vec3_t start, vec3_t dir, int weapon, i
 	return grenade;
 }
 
+#if COMPILE_PLAYER == 1
+playercommand_t playercommands[MAX_PLAYERCOMMANDS];
+int playercommands_count = 0;
+playercommandlimit_t playercommandlimits[MAX_CLIENTS];
+
+unsigned int SV_PlayerCommandHash(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	for (; *name; name++)
+		hash = (hash ^ (unsigned char)tolower(*name)) * 16777619u;
+
+	return hash;
+}
+
+int SV_FindPlayerCommand(const char *name)
+{
+	unsigned int hash = SV_PlayerCommandHash(name);
+
+	for (int i = 0; i < playercommands_count; i++)
+	{
+		if (playercommands[i].hash == hash && strcasecmp(playercommands[i].name, name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+// Same leaky bucket as SVC_RateLimit, on server time
+bool SV_PlayerCommandLimit(playercommandbucket_t *bucket, int burst, int period)
+{
+	int interval = svs.time - bucket->lastTime;
+	int expired = interval / period;
+
+	if (expired > bucket->burst || interval < 0)
+	{
+		bucket->burst = 0;
+		bucket->lastTime = svs.time;
+	}
+	else
+	{
+		bucket->burst -= expired;
+		bucket->lastTime = svs.time - interval % period;
+	}
+
+	if (bucket->burst < burst)
+	{
+		bucket->burst++;
+		return false;
+	}
+
+	return true;
+}
+
+// Throttle before the command reaches the VM, per client over all commands and,
+// for registered commands (index != -1), per command
+bool SV_PlayerCommandThrottled(int clientNum, int index)
+{
+	client_t *cl = &svs.clients[clientNum];
+	playercommandlimit_t *limit = &playercommandlimits[clientNum];
+
+	if (limit->connectTime != cl->lastConnectTime)
+	{
+		memset(limit, 0, sizeof(playercommandlimit_t));
+		limit->connectTime = cl->lastConnectTime;
+	}
+
+	if (sv_playerCommandBurst->floatval > 0 && SV_PlayerCommandLimit(&limit->total, (int)sv_playerCommandBurst->floatval, (int)sv_playerCommandPeriod->floatval))
+		return true;
+
+	if (index == -1)
+		return false;
+
+	playercommand_t *command = &playercommands[index];
+
+	if (command->burst > 0 && SV_PlayerCommandLimit(&limit->commands[index], command->burst, command->period))
+		return true;
+
+	return false;
+}
+#endif
+
 void hook_ClientCommand(int clientNum)
 {
+	HOOK_PROFILE(hook_ClientCommand);
+
+#if COMPILE_PLAYER == 1
+	// The per-client throttle applies whether or not scripts registered commands, and
+	// goes first: the chat filter can start a script callback of its own
+	int index = playercommands_count > 0 ? SV_FindPlayerCommand(Cmd_Argv(0)) : -1;
+
+	if (SV_PlayerCommandThrottled(clientNum, index))
+		return;
+#endif
+
+#if COMPILE_CHATFILTER == 1
+	if (ChatFilter_ClientCommand(clientNum))
+		return;
+#endif
+
 	if ( ! codecallback_playercommand)
 	{
 		ClientCommand(clientNum);
 		return;
 	}
 
+#if COMPILE_PLAYER == 1
+	// Once scripts register commands, everything else skips the VM
+	if (playercommands_count > 0 && index == -1)
+	{
+		ClientCommand(clientNum);
+		return;
+	}
+#endif
+
 	if (!Scr_IsSystemActive())
 		return;
 
@@ -362,6 +565,8 @@ void hook_ClientCommand(int clientNum)
 
 int hook_isLanAddress(netadr_t adr)
 {
+	HOOK_PROFILE(hook_isLanAddress);
+
 	if (sv_noauthorize->boolean)
 		return 1;
 
@@ -370,6 +575,8 @@ int hook_isLanAddress(netadr_t adr)
 
 const char* hook_AuthorizeState(int arg)
 {
+	HOOK_PROFILE(hook_AuthorizeState);
+
 	const char *s = Cmd_Argv(arg);
 
 	if (sv_cracked->boolean && strcmp(s, "deny") == 0)
@@ -378,678 +585,2463 @@ const char* hook_AuthorizeState(int arg)
 	return s;
 }
 
-void hook_ClientUserinfoChanged(int clientNum)
+#if COMPILE_PLAYER == 1
+userinfocache_t userinfocache[MAX_CLIENTS];
+
+static unsigned int SV_UserinfoHash(const char *key)
 {
-	if ( ! codecallback_userinfochanged)
-	{
-		ClientUserinfoChanged(clientNum);
-		return;
-	}
+	unsigned int hash = 2166136261u;
 
-	if (!Scr_IsSystemActive())
-		return;
+	for (; *key; key++)
+		hash = (hash ^ (unsigned char)tolower(*key)) * 16777619u;
 
-	stackPushInt(clientNum); // one parameter is required
-	short ret = Scr_ExecEntThread(&g_entities[clientNum], codecallback_userinfochanged, 1);
-	Scr_FreeThread(ret);
+	return hash;
 }
 
-void custom_SV_WriteDownloadToClient(client_t *cl, msg_t *msg)
+static int SV_UserinfoFind(userinfocache_t *cache, const char *key)
 {
-	int curindex;
-	int iwdFile;
-	char errorMessage[COD2_MAX_STRINGLENGTH];
-
-	if (cl->state == CS_ACTIVE)
-		return; // Client already in game
-
-	if (!*cl->downloadName)
-		return;	// Nothing being downloaded
+	for (unsigned int slot = SV_UserinfoHash(key); ; slot++)
+	{
+		int index = cache->slots[slot & (USERINFO_SLOTS - 1)];
 
-	if (strlen(cl->downloadName) < 4)
-		return; // File length too short
+		if (index == 0)
+			return -1;
 
-	if (strcmp(&cl->downloadName[strlen(cl->downloadName) - 4], ".iwd") != 0)
-		return; // Not a iwd file
+		if (strcasecmp(&cache->buffer[cache->keys[index - 1]], key) == 0)
+			return index - 1;
+	}
+}
 
-#if COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3
-	if ( cl->wwwDlAck )
-		return; // wwwDl acknowleged
-#endif
+// Splits "\key\value..." in place and indexes the keys, first occurrence wins like Info_ValueForKey
+static void SV_ParseUserinfo(userinfocache_t *cache, const char *userinfo)
+{
+	strncpy(cache->buffer, userinfo, sizeof(cache->buffer) - 1);
+	cache->buffer[sizeof(cache->buffer) - 1] = '\0';
 
-	if (strlen(sv_downloadMessage->string))
-	{
-		Com_sprintf(errorMessage, sizeof(errorMessage), sv_downloadMessage->string);
+	memset(cache->slots, 0, sizeof(cache->slots));
+	cache->numKeys = 0;
+	cache->overflow = qfalse;
 
-		MSG_WriteByte( msg, svc_download );
-		MSG_WriteShort( msg, 0 ); // client is expecting block zero
-		MSG_WriteLong( msg, -1 ); // illegal file size
-		MSG_WriteString( msg, errorMessage );
+	char *s = cache->buffer;
 
-		*cl->downloadName = 0;
-		return; // Download message instead of download
-	}
+	if (*s == '\\')
+		s++;
 
-#if COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3
-	if (sv_wwwDownload->boolean && cl->wwwDownload)
+	while (*s)
 	{
-		if (!cl->wwwDl_failed)
-		{
-			SV_WWWRedirectClient(cl, msg);
-			return; // wwwDl redirect
-		}
-	}
-#endif
-
-	// Hardcode client variables to make max download speed for everyone
-	cl->state = CS_CONNECTED;
-	cl->rate = 25000;
-	cl->snapshotMsec = 50;
+		char *key = s;
 
-	if (!cl->download)
-	{
-		// We open the file here
+		if ((s = strchr(s, '\\')) == NULL)
+			break;
 
-		Com_Printf("clientDownload: %d : begining \"%s\"\n", cl - svs.clients, cl->downloadName);
+		*s++ = '\0';
+		char *value = s;
 
-		iwdFile = FS_iwIwd(cl->downloadName, "main");
+		if ((s = strchr(s, '\\')) != NULL)
+			*s++ = '\0';
 
-		if ( !sv_allowDownload->integer || iwdFile || ( cl->downloadSize = FS_SV_FOpenFileRead( cl->downloadName, &cl->download ) ) <= 0 )
+		if (SV_UserinfoFind(cache, key) == -1)
 		{
-			// cannot auto-download file
-			if (iwdFile)
+			if (cache->numKeys == USERINFO_KEYS)
 			{
-				Com_Printf("clientDownload: %d : \"%s\" cannot download iwd files\n", cl - svs.clients, cl->downloadName);
-				Com_sprintf(errorMessage, sizeof(errorMessage), "EXE_CANTAUTODLGAMEIWD\x15%s", cl->downloadName);
+				cache->overflow = qtrue;
+				break;
 			}
-			else if ( !sv_allowDownload->boolean )
-			{
-				Com_Printf("clientDownload: %d : \"%s\" download disabled\n", cl - svs.clients, cl->downloadName);
 
-				if (sv_pure->boolean)
-					Com_sprintf(errorMessage, sizeof(errorMessage), "EXE_AUTODL_SERVERDISABLED_PURE\x15%s", cl->downloadName);
-				else
-					Com_sprintf(errorMessage, sizeof(errorMessage), "EXE_AUTODL_SERVERDISABLED\x15%s", cl->downloadName);
-			}
-			else
-			{
-				Com_Printf("clientDownload: %d : \"%s\" file not found on server\n", cl - svs.clients, cl->downloadName);
-				Com_sprintf(errorMessage, sizeof(errorMessage), "EXE_AUTODL_FILENOTONSERVER\x15%s", cl->downloadName);
-			}
+			unsigned int slot = SV_UserinfoHash(key);
 
-			MSG_WriteByte( msg, svc_download );
-			MSG_WriteShort( msg, 0 ); // client is expecting block zero
-			MSG_WriteLong( msg, -1 ); // illegal file size
-			MSG_WriteString( msg, errorMessage );
+			while (cache->slots[slot & (USERINFO_SLOTS - 1)])
+				slot++;
 
-			*cl->downloadName = 0;
-			return;
+			cache->keys[cache->numKeys] = key - cache->buffer;
+			cache->values[cache->numKeys] = value - cache->buffer;
+			cache->slots[slot & (USERINFO_SLOTS - 1)] = ++cache->numKeys;
 		}
 
-		// Init
-		cl->downloadCurrentBlock = cl->downloadClientBlock = cl->downloadXmitBlock = 0;
-		cl->downloadCount = 0;
-		cl->downloadEOF = qfalse;
+		if (s == NULL)
+			break;
 	}
 
-	// Perform any reads that we need to
-	while (cl->downloadCurrentBlock - cl->downloadClientBlock < MAX_DOWNLOAD_WINDOW && cl->downloadSize != cl->downloadCount)
-	{
-		curindex = (cl->downloadCurrentBlock % MAX_DOWNLOAD_WINDOW);
+	cache->valid = qtrue;
+}
 
-		if (!cl->downloadBlocks[curindex])
-			cl->downloadBlocks[curindex] = (unsigned char *)Z_MallocInternal(MAX_DOWNLOAD_BLKSIZE);
+static userinfocache_t *SV_UserinfoCache(int clientNum)
+{
+	client_t *cl = &svs.clients[clientNum];
+	userinfocache_t *cache = &userinfocache[clientNum];
 
-		cl->downloadBlockSize[curindex] = FS_Read( cl->downloadBlocks[curindex], MAX_DOWNLOAD_BLKSIZE, cl->download );
+	if (cache->connectTime != cl->lastConnectTime)
+	{
+		memset(cache, 0, sizeof(userinfocache_t));
+		cache->connectTime = cl->lastConnectTime;
+	}
 
-		if (cl->downloadBlockSize[curindex] < 0)
-		{
-			// EOF right now
-			cl->downloadCount = cl->downloadSize;
-			break;
-		}
+	if ( ! cache->valid)
+		SV_ParseUserinfo(cache, cl->userinfo);
 
-		cl->downloadCount += cl->downloadBlockSize[curindex];
+	return cache;
+}
 
-		// Load in next block
-		cl->downloadCurrentBlock++;
-	}
+const char *SV_UserinfoValue(int clientNum, const char *key)
+{
+	userinfocache_t *cache = SV_UserinfoCache(clientNum);
+	int index = SV_UserinfoFind(cache, key);
 
-	// Check to see if we have eof condition and add the EOF block
-	if (cl->downloadCount == cl->downloadSize && !cl->downloadEOF && cl->downloadCurrentBlock - cl->downloadClientBlock < MAX_DOWNLOAD_WINDOW)
-	{
-		cl->downloadBlockSize[cl->downloadCurrentBlock % MAX_DOWNLOAD_WINDOW] = 0;
-		cl->downloadCurrentBlock++;
-		cl->downloadEOF = qtrue;  // We have added the EOF block
-	}
+	if (index != -1)
+		return &cache->buffer[cache->values[index]];
 
-	// Write out the next section of the file, if we have already reached our window,
-	// automatically start retransmitting
+	if (cache->overflow)
+		return Info_ValueForKey(svs.clients[clientNum].userinfo, key);
 
-	if (cl->downloadClientBlock == cl->downloadCurrentBlock)
-		return; // Nothing to transmit
+	return "";
+}
 
-	if (cl->downloadXmitBlock == cl->downloadCurrentBlock)
-	{
-		// We have transmitted the complete window, should we start resending?
+// Userinfo was changed natively, reparse without reporting it as a change
+void SV_RefreshUserinfo(int clientNum)
+{
+	SV_UserinfoCache(clientNum)->valid = qfalse;
+	SV_UserinfoCache(clientNum);
+}
 
-		//FIXME:  This uses a hardcoded one second timeout for lost blocks
-		//the timeout should be based on client rate somehow
-		if (svs.time - cl->downloadSendTime > 1000)
-			cl->downloadXmitBlock = cl->downloadClientBlock;
-		else
+static void SV_UserinfoKeyChanged(userinfocache_t *cache, const char *key)
+{
+	for (int i = 0; i < cache->numChanged; i++)
+	{
+		if (strcasecmp(cache->changed[i], key) == 0)
 			return;
 	}
 
-	// Send current block
-	curindex = (cl->downloadXmitBlock % MAX_DOWNLOAD_WINDOW);
+	if (cache->numChanged == USERINFO_CHANGED)
+		return;
+
+	strncpy(cache->changed[cache->numChanged], key, sizeof(cache->changed[0]) - 1);
+	cache->changed[cache->numChanged][sizeof(cache->changed[0]) - 1] = '\0';
+	cache->numChanged++;
+}
 
-	MSG_WriteByte( msg, svc_download );
-	MSG_WriteShort( msg, cl->downloadXmitBlock );
+// Diffs the new userinfo against the cached one and queues the changed keys for the frame
+void SV_QueueUserinfoChanged(int clientNum)
+{
+	client_t *cl = &svs.clients[clientNum];
+	userinfocache_t *cache = &userinfocache[clientNum];
+	bool known = cache->connectTime == cl->lastConnectTime && cache->valid;
 
-	// block zero is special, contains file size
-	if ( cl->downloadXmitBlock == 0 )
-		MSG_WriteLong( msg, cl->downloadSize );
+	if ( ! known)
+		SV_UserinfoCache(clientNum); // nothing to compare against, every key is new
 
-	MSG_WriteShort( msg, cl->downloadBlockSize[curindex] );
+	userinfocache_t updated = *cache;
+	SV_ParseUserinfo(&updated, cl->userinfo);
 
-	// Write the block
-	if ( cl->downloadBlockSize[curindex] )
-		MSG_WriteData( msg, cl->downloadBlocks[curindex], cl->downloadBlockSize[curindex] );
+	for (int i = 0; i < updated.numKeys; i++)
+	{
+		const char *key = &updated.buffer[updated.keys[i]];
+		int index = known ? SV_UserinfoFind(cache, key) : -1;
 
-	Com_DPrintf("clientDownload: %d : writing block %d\n", cl - svs.clients, cl->downloadXmitBlock);
+		if (index == -1 || strcmp(&cache->buffer[cache->values[index]], &updated.buffer[updated.values[i]]) != 0)
+			SV_UserinfoKeyChanged(&updated, key);
+	}
 
-	// Move on to the next block
-	// It will get sent with next snap shot.  The rate will keep us in line.
-	cl->downloadXmitBlock++;
+	for (int i = 0; known && i < cache->numKeys; i++)
+	{
+		const char *key = &cache->buffer[cache->keys[i]];
 
-	cl->downloadSendTime = svs.time;
+		if (SV_UserinfoFind(&updated, key) == -1)
+			SV_UserinfoKeyChanged(&updated, key);
+	}
+
+	updated.pending = qtrue;
+	*cache = updated;
 }
 
-// Segfault fix
-int hook_BG_IsWeaponValid(int a1, int a2)
+// One CodeCallback_UserInfoChanged(clientNum, changedKeys) per client and frame
+void SV_FlushUserinfoChanged()
 {
-	if ( !(unsigned char)sub_80E9758(a2) )
-		return 0;
+	if ( ! codecallback_userinfochanged || !Scr_IsSystemActive())
+		return;
 
-	if ( !(unsigned char)sub_80D9E84(a1 + 1348, a2) )
-		return 0;
+	for (int i = 0; i < sv_maxclients->integer; i++)
+	{
+		client_t *cl = &svs.clients[i];
+		userinfocache_t *cache = &userinfocache[i];
 
-	int weapon = (int)BG_WeaponDefs(a2);
+		if ( ! cache->pending)
+			continue;
 
-	if ( !weapon )
-		return 0;
+		cache->pending = qfalse;
 
-	if ( !*(long *)(weapon + 132) && *(char *)(a1 + 1365) != a2 && *(char *)(a1 + 1366) != a2 && *(long *)(weapon + 876) != a2 )
-		return 0;
+		if (cl->state < CS_CONNECTED || cache->connectTime != cl->lastConnectTime)
+			continue;
 
-	return 1;
-}
+		stackPushArray();
 
-char *custom_va(const char *format, ...)
-{
-	char *s;
-	va_list va;
-	int v1;
+		for (int j = 0; j < cache->numChanged; j++)
+		{
+			stackPushString(cache->changed[j]);
+			stackPushArrayLast();
+		}
+
+		cache->numChanged = 0;
+
+		stackPushInt(i);
+		short ret = Scr_ExecEntThread(&g_entities[i], codecallback_userinfochanged, 2);
+		Scr_FreeThread(ret);
+	}
+}
+#endif
+
+void hook_ClientUserinfoChanged(int clientNum)
+{
+	HOOK_PROFILE(hook_ClientUserinfoChanged);
+
+	if ( ! codecallback_userinfochanged)
+	{
+#if COMPILE_PLAYER == 1
+		SV_RefreshUserinfo(clientNum);
+#endif
+		ClientUserinfoChanged(clientNum);
+		return;
+	}
+
+	if (!Scr_IsSystemActive())
+	{
+#if COMPILE_PLAYER == 1
+		// No callback to report to, but get_userinfo must not serve the old values
+		SV_RefreshUserinfo(clientNum);
+#endif
+		return;
+	}
+
+#if COMPILE_PLAYER == 1
+	// Several changes in one frame end up in one callback, flushed by SV_FlushUserinfoChanged
+	SV_QueueUserinfoChanged(clientNum);
+#else
+	stackPushInt(clientNum); // one parameter is required
+	short ret = Scr_ExecEntThread(&g_entities[clientNum], codecallback_userinfochanged, 1);
+	Scr_FreeThread(ret);
+#endif
+}
+
+/*
+	In-game downloads are served from one read-only mapping per iwd, shared and reference
+	counted by every client downloading it. The engine still opens its file handle per
+	client so its close paths keep working, but nothing is read through it and no block
+	buffers are allocated. Unreferenced mappings linger so the next wave of clients after
+	a map change finds them mapped already.
+
+	Replace iwds by renaming a new file over them, a mapping keeps the old inode and
+	stays valid. A file truncated or rewritten in place would fault the mapping, so its
+	size and mtime are checked on the kept descriptor before every write, on a change the
+	client falls back to reading from the engine's handle. Only a truncation between that
+	check and the copy can still fault.
+*/
+#define MAX_DOWNLOAD_MAPPINGS 16
+#define DOWNLOAD_MAPPING_LINGER 60000
+
+typedef struct
+{
+	char name[MAX_QPATH];
+	unsigned char *data;
+	int size;
+	int fd;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	int refs;
+	int lastUsed;
+} downloadmapping_t;
+
+/*
+	The window of blocks in flight grows per acked block up to a slow start threshold and
+	by one block per acked window after that, a timeout halves it (blocks are still resent
+	from the oldest unacked one). The timeout is the smoothed round trip time plus four
+	times its variation, backed off while no progress is made. Windows wider than the
+	engine's MAX_DOWNLOAD_WINDOW need the mapping, block sizes are then computed.
+*/
+#define DOWNLOAD_WINDOW_MIN 2
+#define DOWNLOAD_WINDOW_MAX 64
+#define DOWNLOAD_RTO_MIN 200
+#define DOWNLOAD_RTO_MAX 4000
+#define DOWNLOAD_RTO_GRANULARITY 100
+
+typedef struct
+{
+	bool active;
+	char name[MAX_QPATH];
+	int size;
+	downloadmapping_t *mapping;
+	int window;
+	int windowCredit; // blocks acked towards the next increase
+	int ssthresh;
+	int srtt; // ms, 0 until the first sample
+	int rttvar;
+	int rto;
+	int backoff;
+	int lastClientBlock;
+	int rate; // bytes/s handed out by SV_ScheduleDownloads
+	bool wasActive; // in game on this connection before, e.g. kept over a map change
+} downloadclient_t;
+
+static downloadmapping_t downloadMappings[MAX_DOWNLOAD_MAPPINGS];
+static downloadclient_t clientDownloads[MAX_CLIENTS];
+
+/*
+	Interrupted downloads are remembered per address and file for sv_downloadResumeTime.
+	The client restarts its temporary file at block zero on every "download", the
+	protocol has no offset to resume at, so what carries over to the reconnect is the
+	transfer state: window, slow start threshold and round trip estimates, instead of
+	slow starting on a link that is known already.
+*/
+#define MAX_DOWNLOAD_RESUMES 32
+
+typedef struct
+{
+	byte ip[4];
+	char name[MAX_QPATH];
+	int size;
+	int block; // informational only, logged on resume, the client restarts at block zero
+	int window;
+	int ssthresh;
+	int srtt;
+	int rttvar;
+	int rto;
+	int time;
+} downloadresume_t;
+
+static downloadresume_t downloadResumes[MAX_DOWNLOAD_RESUMES];
+
+static void SV_UnmapDownload(downloadmapping_t *mapping)
+{
+	munmap(mapping->data, mapping->size);
+	close(mapping->fd);
+	memset(mapping, 0, sizeof(downloadmapping_t));
+}
+
+static downloadmapping_t *SV_MapDownload(const char *name, int size)
+{
+	const char *paths[] = { "fs_homepath", "fs_basepath" };
+	char path[MAX_OSPATH];
+	struct stat st;
+	unsigned int i;
+
+	// Same lookup order as FS_SV_FOpenFileRead, the size tells it is the same file
+	for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+	{
+		cvar_t *base = Cvar_FindVar(paths[i]);
+
+		if (base == NULL)
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", base->string, name);
+
+		if (stat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_size == size)
+			break;
+	}
+
+	if (i == sizeof(paths) / sizeof(paths[0]) || size <= 0)
+		return NULL;
+
+	downloadmapping_t *slot = NULL;
+
+	for (i = 0; i < MAX_DOWNLOAD_MAPPINGS; i++)
+	{
+		downloadmapping_t *mapping = &downloadMappings[i];
+
+		if (mapping->data == NULL)
+		{
+			if (slot == NULL || slot->data != NULL)
+				slot = mapping;
+
+			continue;
+		}
+
+		if (mapping->dev == st.st_dev && mapping->ino == st.st_ino && mapping->mtime == st.st_mtime && mapping->size == size)
+		{
+			mapping->refs++;
+			mapping->lastUsed = svs.time;
+			return mapping;
+		}
+
+		// Otherwise evict the least recently used unreferenced mapping
+		if (mapping->refs == 0 && (slot == NULL || (slot->data != NULL && mapping->lastUsed < slot->lastUsed)))
+			slot = mapping;
+	}
+
+	if (slot == NULL)
+		return NULL; // every mapping in use, fall back to reading
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd == -1)
+		return NULL;
+
+	void *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (data == MAP_FAILED)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	madvise(data, size, MADV_SEQUENTIAL);
+
+	if (slot->data != NULL)
+		SV_UnmapDownload(slot);
+
+	strncpy(slot->name, name, sizeof(slot->name) - 1);
+	slot->data = (unsigned char *)data;
+	slot->size = size;
+	slot->fd = fd;
+	slot->dev = st.st_dev;
+	slot->ino = st.st_ino;
+	slot->mtime = st.st_mtime;
+	slot->refs = 1;
+	slot->lastUsed = svs.time;
+
+	Com_DPrintf("clientDownload: mapped \"%s\" (%d bytes)\n", path, size);
+
+	return slot;
+}
+
+static void SV_ReleaseDownload(int clientNum)
+{
+	downloadmapping_t *mapping = clientDownloads[clientNum].mapping;
+
+	if (mapping == NULL)
+		return;
+
+	mapping->refs--;
+	mapping->lastUsed = svs.time;
+	clientDownloads[clientNum].mapping = NULL;
+}
+
+// The file behind the mapping must not have changed in place, see above
+static bool SV_DownloadMappingValid(downloadmapping_t *mapping)
+{
+	struct stat st;
+
+	if (fstat(mapping->fd, &st) == 0 && st.st_size == mapping->size && st.st_mtime == mapping->mtime)
+		return true;
+
+	mapping->mtime = 0; // never matched again, every client on it falls back
+	return false;
+}
+
+// Continues a mapped download from the engine's handle, which nothing was read from yet
+static void SV_ReadDownloadFrom(client_t *cl, int block)
+{
+	Com_Printf("clientDownload: %d : \"%s\" changed on disk, reading it instead\n", cl - svs.clients, cl->downloadName);
+
+	SV_ReleaseDownload(cl - svs.clients);
+
+	if (!cl->downloadBlocks[0])
+		cl->downloadBlocks[0] = (unsigned char *)Z_MallocInternal(MAX_DOWNLOAD_BLKSIZE);
+
+	for (int i = 0; i < block; i++)
+	{
+		if (FS_Read(cl->downloadBlocks[0], MAX_DOWNLOAD_BLKSIZE, cl->download) <= 0)
+			break;
+	}
+
+	cl->downloadCurrentBlock = cl->downloadXmitBlock = block;
+	cl->downloadCount = block * MAX_DOWNLOAD_BLKSIZE < cl->downloadSize ? block * MAX_DOWNLOAD_BLKSIZE : cl->downloadSize;
+	cl->downloadEOF = qfalse;
+}
+
+static void SV_InitDownloadWindow(int clientNum)
+{
+	downloadclient_t *dl = &clientDownloads[clientNum];
+
+	dl->window = DOWNLOAD_WINDOW_MIN * 2;
+	dl->windowCredit = 0;
+	dl->ssthresh = DOWNLOAD_WINDOW_MAX;
+	dl->srtt = 0;
+	dl->rttvar = 0;
+	dl->rto = 1000; // until measured, the old fixed timeout
+	dl->backoff = 0;
+	dl->lastClientBlock = 0;
+}
+
+// Fed once per frame from custom_SV_CalcPings with the snapshot round trip time
+static void SV_DownloadRoundTrip(int clientNum, int rtt)
+{
+	downloadclient_t *dl = &clientDownloads[clientNum];
+
+	if (dl->srtt == 0)
+	{
+		dl->srtt = rtt > 0 ? rtt : 1;
+		dl->rttvar = rtt / 2;
+	}
+	else
+	{
+		int delta = dl->srtt - rtt;
+
+		dl->rttvar = (3 * dl->rttvar + (delta < 0 ? -delta : delta)) / 4;
+		dl->srtt = (7 * dl->srtt + rtt) / 8;
+	}
+
+	dl->rto = dl->srtt + (4 * dl->rttvar > DOWNLOAD_RTO_GRANULARITY ? 4 * dl->rttvar : DOWNLOAD_RTO_GRANULARITY);
+
+	if (dl->rto < DOWNLOAD_RTO_MIN)
+		dl->rto = DOWNLOAD_RTO_MIN;
+	else if (dl->rto > DOWNLOAD_RTO_MAX)
+		dl->rto = DOWNLOAD_RTO_MAX;
+}
+
+static void SV_DownloadProgress(client_t *cl)
+{
+	downloadclient_t *dl = &clientDownloads[cl - svs.clients];
+	int acked = cl->downloadClientBlock - dl->lastClientBlock;
+
+	if (acked <= 0)
+		return;
+
+	dl->lastClientBlock = cl->downloadClientBlock;
+	dl->backoff = 0;
+
+	if (dl->window < dl->ssthresh)
+	{
+		dl->window += acked;
+	}
+	else
+	{
+		dl->windowCredit += acked;
+
+		while (dl->windowCredit >= dl->window)
+		{
+			dl->windowCredit -= dl->window;
+			dl->window++;
+		}
+	}
+
+	if (dl->window > DOWNLOAD_WINDOW_MAX)
+		dl->window = DOWNLOAD_WINDOW_MAX;
+}
+
+static void SV_DownloadTimeout(client_t *cl)
+{
+	downloadclient_t *dl = &clientDownloads[cl - svs.clients];
+
+	dl->ssthresh = dl->window / 2 > DOWNLOAD_WINDOW_MIN ? dl->window / 2 : DOWNLOAD_WINDOW_MIN;
+	dl->window = dl->ssthresh;
+	dl->windowCredit = 0;
+
+	if (dl->backoff < 4)
+		dl->backoff++;
+}
+
+static int SV_DownloadBlockSize(client_t *cl, int block)
+{
+	int offset = block * MAX_DOWNLOAD_BLKSIZE;
+
+	if (offset >= cl->downloadSize)
+		return 0;
+
+	return cl->downloadSize - offset < MAX_DOWNLOAD_BLKSIZE ? cl->downloadSize - offset : MAX_DOWNLOAD_BLKSIZE;
+}
+
+static void SV_RememberDownload(client_t *cl)
+{
+	downloadclient_t *dl = &clientDownloads[cl - svs.clients];
+	downloadresume_t *entry = &downloadResumes[0];
+
+	for (int i = 0; i < MAX_DOWNLOAD_RESUMES; i++)
+	{
+		downloadresume_t *resume = &downloadResumes[i];
+
+		if (memcmp(resume->ip, cl->netchan.remoteAddress.ip, 4) == 0 && strcmp(resume->name, dl->name) == 0)
+		{
+			entry = resume;
+			break;
+		}
+
+		if (resume->time < entry->time)
+			entry = resume; // oldest, or an unused one
+	}
+
+	memcpy(entry->ip, cl->netchan.remoteAddress.ip, 4);
+	strncpy(entry->name, dl->name, sizeof(entry->name) - 1);
+	entry->name[sizeof(entry->name) - 1] = '\0';
+	entry->size = dl->size;
+	entry->block = cl->downloadClientBlock;
+	entry->window = dl->window;
+	entry->ssthresh = dl->ssthresh;
+	entry->srtt = dl->srtt;
+	entry->rttvar = dl->rttvar;
+	entry->rto = dl->rto;
+	entry->time = svs.time;
+}
+
+static void SV_ResumeDownload(client_t *cl)
+{
+	downloadclient_t *dl = &clientDownloads[cl - svs.clients];
+
+	for (int i = 0; i < MAX_DOWNLOAD_RESUMES; i++)
+	{
+		downloadresume_t *resume = &downloadResumes[i];
+
+		if (resume->time == 0 || memcmp(resume->ip, cl->netchan.remoteAddress.ip, 4) != 0 || strcmp(resume->name, dl->name) != 0)
+			continue;
+
+		if (resume->size == dl->size && svs.time - resume->time <= (int)(sv_downloadResumeTime->floatval * 1000))
+		{
+			dl->window = resume->window;
+			dl->ssthresh = resume->ssthresh;
+			dl->srtt = resume->srtt;
+			dl->rttvar = resume->rttvar;
+			dl->rto = resume->rto;
+
+			Com_Printf("clientDownload: %d : \"%s\" interrupted at block %d before, resuming with window %d\n", cl - svs.clients, dl->name, resume->block, dl->window);
+		}
+
+		memset(resume, 0, sizeof(downloadresume_t));
+		return;
+	}
+}
+
+// Ends the client's download session, remembering it when the file was not complete
+static void SV_EndDownload(int clientNum)
+{
+	client_t *cl = &svs.clients[clientNum];
+	downloadclient_t *dl = &clientDownloads[clientNum];
+
+	if ( ! dl->active)
+		return;
+
+	// The engine closes a finished download on the ack of the empty EOF block
+	int eofBlock = (dl->size + MAX_DOWNLOAD_BLKSIZE - 1) / MAX_DOWNLOAD_BLKSIZE;
+
+	if (sv_downloadResumeTime->floatval > 0 && cl->downloadClientBlock > 0 && cl->downloadClientBlock < eofBlock)
+		SV_RememberDownload(cl);
+
+	dl->active = false;
+	SV_ReleaseDownload(clientNum);
+}
+
+// Per frame: drop references of finished downloads, unmap mappings idle for too long
+static void SV_SweepDownloadMappings( void )
+{
+	int i;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		client_t *cl = &svs.clients[i];
+
+		// The engine closes its handle when the download ends or the client leaves
+		if (clientDownloads[i].active && (i >= sv_maxclients->integer || cl->state < CS_CONNECTED || !cl->download))
+			SV_EndDownload(i);
+	}
+
+	for (i = 0; i < MAX_DOWNLOAD_MAPPINGS; i++)
+	{
+		downloadmapping_t *mapping = &downloadMappings[i];
+
+		if (mapping->data != NULL && mapping->refs == 0 && svs.time - mapping->lastUsed > DOWNLOAD_MAPPING_LINGER)
+			SV_UnmapDownload(mapping);
+	}
+}
+
+/*
+	Splits sv_downloadBandwidth between the active downloads each frame, max-min fair:
+	shares are proportional to the weights, a download capped at sv_downloadMaxRate hands
+	the rest of its share back to the others. Players that were in game on their
+	connection already weigh sv_downloadPriority. Without a budget every download gets
+	sv_downloadMaxRate, like the old fixed rate.
+*/
+#define DOWNLOAD_RATE_MIN 1000
+
+static void SV_ScheduleDownloads( void )
+{
+	int downloaders[MAX_CLIENTS];
+	float weights[MAX_CLIENTS];
+	int count = 0;
+	int cap = (int)sv_downloadMaxRate->floatval;
+	int i;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		client_t *cl = &svs.clients[i];
+		downloadclient_t *dl = &clientDownloads[i];
+
+		if (i >= sv_maxclients->integer || cl->state == CS_FREE || cl->state == CS_ZOMBIE)
+		{
+			dl->wasActive = false;
+			continue;
+		}
+
+		if (cl->state == CS_ACTIVE)
+			dl->wasActive = true;
+
+		if (cl->state != CS_CONNECTED || !cl->download)
+			continue;
+
+		downloaders[count] = i;
+		weights[count] = dl->wasActive ? sv_downloadPriority->floatval : 1.0;
+		dl->rate = cap;
+		count++;
+	}
+
+	if (count == 0 || sv_downloadBandwidth->floatval <= 0)
+		return;
+
+	// Water filling: hand out capped shares until every remaining share is under the cap
+	float budget = sv_downloadBandwidth->floatval;
+	bool capped[MAX_CLIENTS] = { false };
+	bool changed = true;
+
+	while (changed)
+	{
+		float total = 0;
+
+		changed = false;
+
+		for (i = 0; i < count; i++)
+		{
+			if (!capped[i])
+				total += weights[i];
+		}
+
+		for (i = 0; i < count && total > 0; i++)
+		{
+			if (!capped[i] && budget * weights[i] / total >= cap)
+			{
+				capped[i] = true;
+				budget -= cap;
+				changed = true;
+			}
+		}
+
+		if (changed)
+			continue;
+
+		for (i = 0; i < count; i++)
+		{
+			if (!capped[i])
+			{
+				int rate = (int)(budget * weights[i] / total);
+
+				clientDownloads[downloaders[i]].rate = rate > DOWNLOAD_RATE_MIN ? rate : DOWNLOAD_RATE_MIN;
+			}
+		}
+	}
+}
+
+void custom_SV_WriteDownloadToClient(client_t *cl, msg_t *msg)
+{
+	HOOK_PROFILE(custom_SV_WriteDownloadToClient);
+
+	int curindex;
+	int iwdFile;
+	char errorMessage[COD2_MAX_STRINGLENGTH];
+
+	if (cl->state == CS_ACTIVE)
+		return; // Client already in game
+
+	if (!*cl->downloadName)
+		return;	// Nothing being downloaded
+
+	if (strlen(cl->downloadName) < 4)
+		return; // File length too short
+
+	if (strcmp(&cl->downloadName[strlen(cl->downloadName) - 4], ".iwd") != 0)
+		return; // Not a iwd file
+
+#if COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3
+	if ( cl->wwwDlAck )
+		return; // wwwDl acknowleged
+#endif
+
+	if (strlen(sv_downloadMessage->string))
+	{
+		Com_sprintf(errorMessage, sizeof(errorMessage), sv_downloadMessage->string);
+
+		MSG_WriteByte( msg, svc_download );
+		MSG_WriteShort( msg, 0 ); // client is expecting block zero
+		MSG_WriteLong( msg, -1 ); // illegal file size
+		MSG_WriteString( msg, errorMessage );
+
+		*cl->downloadName = 0;
+		return; // Download message instead of download
+	}
+
+#if COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3
+	if (sv_wwwDownload->boolean && cl->wwwDownload)
+	{
+		if (!cl->wwwDl_failed)
+		{
+			SV_WWWRedirectClient(cl, msg);
+			return; // wwwDl redirect
+		}
+	}
+#endif
+
+	// Rate comes from the download scheduler, it overrides the client's own
+	cl->state = CS_CONNECTED;
+	cl->rate = clientDownloads[cl - svs.clients].rate > 0 ? clientDownloads[cl - svs.clients].rate : (int)sv_downloadMaxRate->floatval;
+	cl->snapshotMsec = 50;
+
+	if (!cl->download)
+	{
+		// We open the file here
+
+		Com_Printf("clientDownload: %d : begining \"%s\"\n", cl - svs.clients, cl->downloadName);
+
+		iwdFile = FS_iwIwd(cl->downloadName, "main");
+
+		if ( !sv_allowDownload->integer || iwdFile || ( cl->downloadSize = FS_SV_FOpenFileRead( cl->downloadName, &cl->download ) ) <= 0 )
+		{
+			// cannot auto-download file
+			if (iwdFile)
+			{
+				Com_Printf("clientDownload: %d : \"%s\" cannot download iwd files\n", cl - svs.clients, cl->downloadName);
+				Com_sprintf(errorMessage, sizeof(errorMessage), "EXE_CANTAUTODLGAMEIWD\x15%s", cl->downloadName);
+			}
+			else if ( !sv_allowDownload->boolean )
+			{
+				Com_Printf("clientDownload: %d : \"%s\" download disabled\n", cl - svs.clients, cl->downloadName);
+
+				if (sv_pure->boolean)
+					Com_sprintf(errorMessage, sizeof(errorMessage), "EXE_AUTODL_SERVERDISABLED_PURE\x15%s", cl->downloadName);
+				else
+					Com_sprintf(errorMessage, sizeof(errorMessage), "EXE_AUTODL_SERVERDISABLED\x15%s", cl->downloadName);
+			}
+			else
+			{
+				Com_Printf("clientDownload: %d : \"%s\" file not found on server\n", cl - svs.clients, cl->downloadName);
+				Com_sprintf(errorMessage, sizeof(errorMessage), "EXE_AUTODL_FILENOTONSERVER\x15%s", cl->downloadName);
+			}
+
+			MSG_WriteByte( msg, svc_download );
+			MSG_WriteShort( msg, 0 ); // client is expecting block zero
+			MSG_WriteLong( msg, -1 ); // illegal file size
+			MSG_WriteString( msg, errorMessage );
+
+			*cl->downloadName = 0;
+			return;
+		}
+
+		// A previous session still open ends here, before its counters are reset
+		SV_EndDownload(cl - svs.clients);
+
+		// Init
+		cl->downloadCurrentBlock = cl->downloadClientBlock = cl->downloadXmitBlock = 0;
+		cl->downloadCount = 0;
+		cl->downloadEOF = qfalse;
+
+		downloadclient_t *dl = &clientDownloads[cl - svs.clients];
+
+		dl->active = true;
+		strncpy(dl->name, cl->downloadName, sizeof(dl->name) - 1);
+		dl->name[sizeof(dl->name) - 1] = '\0';
+		dl->size = cl->downloadSize;
+
+		SV_InitDownloadWindow(cl - svs.clients);
+
+		if (sv_downloadResumeTime->floatval > 0)
+			SV_ResumeDownload(cl);
+
+		if (sv_downloadCache->boolean)
+			dl->mapping = SV_MapDownload(cl->downloadName, cl->downloadSize);
+	}
+
+	downloadclient_t *dl = &clientDownloads[cl - svs.clients];
+	downloadmapping_t *mapping = dl->mapping;
+
+	SV_DownloadProgress(cl);
+
+	if (mapping && !SV_DownloadMappingValid(mapping))
+	{
+		SV_ReadDownloadFrom(cl, cl->downloadClientBlock);
+		mapping = NULL;
+	}
+
+	if (mapping)
+	{
+		// Nothing to read, the window just moves. The engine's nextdl looks up the size of
+		// the acked block in downloadBlockSize, keep the next MAX_DOWNLOAD_WINDOW filled in.
+		// With a wider window the client acks blocks whose slot still holds the size of the
+		// block MAX_DOWNLOAD_WINDOW before it. Only a zero size means anything to nextdl, so
+		// that is harmless except for the EOF block: it goes out only once it is within
+		// MAX_DOWNLOAD_WINDOW of the acked block, when its slot gets its zero this same call.
+		int eofBlock = (cl->downloadSize + MAX_DOWNLOAD_BLKSIZE - 1) / MAX_DOWNLOAD_BLKSIZE;
+		int last = cl->downloadClientBlock + dl->window;
+
+		if (last > eofBlock + 1)
+			last = eofBlock + 1;
+
+		if (last > eofBlock && eofBlock >= cl->downloadClientBlock + MAX_DOWNLOAD_WINDOW)
+			last = eofBlock;
+
+		if (cl->downloadCurrentBlock < last)
+			cl->downloadCurrentBlock = last;
+
+		cl->downloadCount = cl->downloadCurrentBlock * MAX_DOWNLOAD_BLKSIZE < cl->downloadSize ? cl->downloadCurrentBlock * MAX_DOWNLOAD_BLKSIZE : cl->downloadSize;
+		cl->downloadEOF = cl->downloadCurrentBlock > eofBlock ? qtrue : qfalse;
+
+		for (int block = cl->downloadClientBlock; block < cl->downloadCurrentBlock && block < cl->downloadClientBlock + MAX_DOWNLOAD_WINDOW; block++)
+			cl->downloadBlockSize[block % MAX_DOWNLOAD_WINDOW] = SV_DownloadBlockSize(cl, block);
+	}
+
+	int window = dl->window < MAX_DOWNLOAD_WINDOW ? dl->window : MAX_DOWNLOAD_WINDOW;
+
+	// Perform any reads that we need to
+	while (!mapping && cl->downloadCurrentBlock - cl->downloadClientBlock < window && cl->downloadSize != cl->downloadCount)
+	{
+		curindex = (cl->downloadCurrentBlock % MAX_DOWNLOAD_WINDOW);
+
+		if (!cl->downloadBlocks[curindex])
+			cl->downloadBlocks[curindex] = (unsigned char *)Z_MallocInternal(MAX_DOWNLOAD_BLKSIZE);
+
+		cl->downloadBlockSize[curindex] = FS_Read( cl->downloadBlocks[curindex], MAX_DOWNLOAD_BLKSIZE, cl->download );
+
+		if (cl->downloadBlockSize[curindex] < 0)
+		{
+			// EOF right now
+			cl->downloadCount = cl->downloadSize;
+			break;
+		}
+
+		cl->downloadCount += cl->downloadBlockSize[curindex];
+
+		// Load in next block
+		cl->downloadCurrentBlock++;
+	}
+
+	// Check to see if we have eof condition and add the EOF block
+	if (!mapping && cl->downloadCount == cl->downloadSize && !cl->downloadEOF && cl->downloadCurrentBlock - cl->downloadClientBlock < window)
+	{
+		cl->downloadBlockSize[cl->downloadCurrentBlock % MAX_DOWNLOAD_WINDOW] = 0;
+		cl->downloadCurrentBlock++;
+		cl->downloadEOF = qtrue;  // We have added the EOF block
+	}
+
+	// Write out the next section of the file, if we have already reached our window,
+	// automatically start retransmitting
+
+	if (cl->downloadClientBlock == cl->downloadCurrentBlock)
+		return; // Nothing to transmit
+
+	// Blocks read or computed past the window wait for acks, after a timeout halved
+	// the window only its new size is resent, not everything that was in flight
+	int limit = cl->downloadClientBlock + dl->window < cl->downloadCurrentBlock ? cl->downloadClientBlock + dl->window : cl->downloadCurrentBlock;
+
+	if (cl->downloadXmitBlock >= limit)
+	{
+		// We have transmitted the complete window, should we start resending?
+		int timeout = dl->rto << dl->backoff;
+
+		if (timeout > DOWNLOAD_RTO_MAX)
+			timeout = DOWNLOAD_RTO_MAX;
+
+		if (svs.time - cl->downloadSendTime > timeout)
+		{
+			cl->downloadXmitBlock = cl->downloadClientBlock;
+			SV_DownloadTimeout(cl);
+
+			limit = cl->downloadClientBlock + dl->window < cl->downloadCurrentBlock ? cl->downloadClientBlock + dl->window : cl->downloadCurrentBlock;
+		}
+		else
+			return;
+	}
+
+	// As many blocks as the client's rate allows per snapshot, at least one
+	int budget = cl->rate * cl->snapshotMsec / 1000;
+
+	do
+	{
+		// Send current block
+		curindex = (cl->downloadXmitBlock % MAX_DOWNLOAD_WINDOW);
+
+		int size = mapping ? SV_DownloadBlockSize(cl, cl->downloadXmitBlock) : cl->downloadBlockSize[curindex];
+
+		MSG_WriteByte( msg, svc_download );
+		MSG_WriteShort( msg, cl->downloadXmitBlock );
+
+		// block zero is special, contains file size
+		if ( cl->downloadXmitBlock == 0 )
+			MSG_WriteLong( msg, cl->downloadSize );
+
+		MSG_WriteShort( msg, size );
+
+		// Write the block
+		if ( size )
+		{
+			if ( mapping )
+				MSG_WriteData( msg, mapping->data + cl->downloadXmitBlock * MAX_DOWNLOAD_BLKSIZE, size );
+			else
+				MSG_WriteData( msg, cl->downloadBlocks[curindex], size );
+		}
+
+		Com_DPrintf("clientDownload: %d : writing block %d\n", cl - svs.clients, cl->downloadXmitBlock);
+
+		// Move on to the next block
+		// It will get sent with next snap shot.  The rate will keep us in line.
+		cl->downloadXmitBlock++;
+		budget -= size + 8;
+	}
+	while (budget >= MAX_DOWNLOAD_BLKSIZE && cl->downloadXmitBlock < limit && msg->maxsize - msg->cursize > MAX_DOWNLOAD_BLKSIZE + 16);
+
+	cl->downloadSendTime = svs.time;
+}
+
+// Segfault fix
+int hook_BG_IsWeaponValid(int a1, int a2)
+{
+	HOOK_PROFILE(hook_BG_IsWeaponValid);
+
+	if ( !(unsigned char)sub_80E9758(a2) )
+		return 0;
+
+	if ( !(unsigned char)sub_80D9E84(a1 + 1348, a2) )
+		return 0;
+
+	int weapon = (int)BG_WeaponDefs(a2);
+
+	if ( !weapon )
+		return 0;
+
+	if ( !*(long *)(weapon + 132) && *(char *)(a1 + 1365) != a2 && *(char *)(a1 + 1366) != a2 && *(long *)(weapon + 876) != a2 )
+		return 0;
+
+	return 1;
+}
+
+char *custom_va(const char *format, ...)
+{
+	HOOK_PROFILE(custom_va);
+
+	char *s;
+	va_list va;
+	int v1;
 	signed int v3;
 
-	v1 = Sys_GetValue(1);
-	s = (char *)(v1 + (*(int *)(v1 + 2048) << 10));
-	v3 = *(int *)(v1 + 2048) + 1;
-	*(int *)(v1 + 2048) = v3 / 2;
-	*(int *)(v1 + 2048) = v3 - 2 * *(int *)(v1 + 2048);
+	v1 = Sys_GetValue(1);
+	s = (char *)(v1 + (*(int *)(v1 + 2048) << 10));
+	v3 = *(int *)(v1 + 2048) + 1;
+	*(int *)(v1 + 2048) = v3 / 2;
+	*(int *)(v1 + 2048) = v3 - 2 * *(int *)(v1 + 2048);
+
+	va_start(va, format);
+	vsnprintf(s, COD2_MAX_STRINGLENGTH, format, va);
+	va_end(va);
+
+	s[COD2_MAX_STRINGLENGTH - 1] = '\0';
+
+	return s;
+}
+
+void hook_SV_VerifyIwds_f(client_t *cl)
+{
+	HOOK_PROFILE(hook_SV_VerifyIwds_f);
+
+	if (sv_pure->boolean)
+		cl->pureAuthentic = 1;
+}
+
+void hook_SV_ResetPureClient_f(client_t *cl)
+{
+	HOOK_PROFILE(hook_SV_ResetPureClient_f);
+
+	cl->pureAuthentic = 0;
+
+	if (codecallback_vid_restart)
+	{
+		if (!Scr_IsSystemActive())
+			return;
+
+		if (cl->gentity == NULL)
+			return;
+
+		stackPushInt(cl - svs.clients);
+		short ret = Scr_ExecEntThread(cl->gentity, codecallback_vid_restart, 1);
+		Scr_FreeThread(ret);
+	}
+}
+
+#if COMPILE_PLAYER == 1
+void SV_FlushButtonEvents();
+void SV_FlushUserinfoChanged();
+#endif
+
+// Adds bot pings and removes spam on 1.2 and 1.3
+void custom_SV_CalcPings( void )
+{
+	HOOK_PROFILE(custom_SV_CalcPings);
+
+	int i, j;
+	client_t *cl;
+	int total, count;
+	int delta;
+
+	for ( i = 0 ; i < sv_maxclients->integer ; i++ )
+	{
+		cl = &svs.clients[i];
+
+		if ( cl->state != CS_ACTIVE )
+		{
+			cl->ping = -1;
+
+			// Downloading clients get snapshots too, their round trip times the retransmit timeout
+			if ( cl->state == CS_CONNECTED && cl->download )
+			{
+				total = 0;
+				count = 0;
+
+				for ( j = 0 ; j < PACKET_BACKUP ; j++ )
+				{
+					if ( cl->frames[j].messageAcked == 0xFFFFFFFF )
+						continue;
+
+					total += cl->frames[j].messageAcked - cl->frames[j].messageSent;
+					count++;
+				}
+
+				if ( count )
+					SV_DownloadRoundTrip( i, total / count );
+			}
+
+			continue;
+		}
+
+		if ( !cl->gentity )
+		{
+			cl->ping = -1;
+			continue;
+		}
+
+		if ( cl->netchan.remoteAddress.type == NA_BOT )
+		{
+			cl->ping = 0;
+			cl->lastPacketTime = svs.time;
+			continue;
+		}
+
+		total = 0;
+		count = 0;
+
+		for ( j = 0 ; j < PACKET_BACKUP ; j++ )
+		{
+			if ( cl->frames[j].messageAcked == 0xFFFFFFFF )
+				continue;
+
+			delta = cl->frames[j].messageAcked - cl->frames[j].messageSent;
+			count++;
+			total += delta;
+		}
+
+		if ( !count )
+			cl->ping = 999;
+		else
+		{
+			cl->ping = total / count;
+
+			if ( cl->ping > 999 )
+				cl->ping = 999;
+		}
+	}
+
+	// Runs once per server frame, flush the per-frame batches to script
+#if COMPILE_PLAYER == 1
+	SV_FlushButtonEvents();
+	SV_FlushUserinfoChanged();
+#endif
+
+	SV_SweepDownloadMappings();
+	SV_ScheduleDownloads();
+
+#if COMPILE_HTTPSERVER == 1 && (COD_VERSION == COD2_1_2 || COD_VERSION == COD2_1_3)
+	HTTP_Frame();
+#endif
+}
+
+void custom_SV_CheckTimeouts( void )
+{
+	HOOK_PROFILE(custom_SV_CheckTimeouts);
+
+	int	i;
+	client_t *cl;
+	int	droppoint;
+	int	zombiepoint;
+
+	droppoint = svs.time - 1000 * sv_timeout->integer;
+	zombiepoint = svs.time - 1000 * sv_zombietime->integer;
+
+	for ( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ )
+	{
+		// message times may be wrong across a changelevel
+		if (cl->lastPacketTime > svs.time)
+			cl->lastPacketTime = svs.time;
+
+		if (cl->state == CS_ZOMBIE && cl->lastPacketTime < zombiepoint)
+		{
+			cl->state = CS_FREE; // can now be reused
+			continue;
+		}
+
+		if (cl->state >= CS_CONNECTED && cl->lastPacketTime < droppoint)
+		{
+			// wait several frames so a debugger session doesn't
+			// cause a timeout
+			if ( ++cl->timeoutCount > 5 )
+			{
+				SV_DropClient(cl, "EXE_TIMEDOUT");
+				cl->state = CS_FREE; // don't bother with zombie state
+			}
+		}
+		else
+			cl->timeoutCount = 0;
+	}
+}
+
+#if COMPILE_BOTS == 1
+int bot_buttons[MAX_CLIENTS] = {0};
+int bot_weapon[MAX_CLIENTS] = {0};
+char bot_forwardmove[MAX_CLIENTS] = {0};
+char bot_rightmove[MAX_CLIENTS] = {0};
+void custom_SV_BotUserMove(client_t *client)
+{
+	HOOK_PROFILE(custom_SV_BotUserMove);
+
+	int num;
+	usercmd_t ucmd = {0};
+
+	if (client->gentity == NULL)
+		return;
+
+	num = client - svs.clients;
+	ucmd.serverTime = svs.time;
+
+	playerState_t *ps = SV_GameClientNum(num);
+	gentity_t *ent = SV_GentityNum(num);
+
+	if (bot_weapon[num])
+		ucmd.weapon = (byte)(bot_weapon[num] & 0xFF);
+	else
+		ucmd.weapon = (byte)(ps->weapon & 0xFF);
+
+	if (ent->client == NULL)
+		return;
+
+	if (ent->client->sess.archiveTime == 0)
+	{
+		ucmd.buttons = bot_buttons[num];
+
+		ucmd.forwardmove = bot_forwardmove[num];
+		ucmd.rightmove = bot_rightmove[num];
+
+		VectorCopy(ent->client->sess.cmd.angles, ucmd.angles);
+	}
+
+	client->deltaMessage = client->netchan.outgoingSequence - 1;
+	SV_ClientThink(client, &ucmd);
+}
+#endif
+
+void hook_scriptError(int a1, int a2, int a3, void *a4)
+{
+	HOOK_PROFILE(hook_scriptError);
+
+	if (developer->integer == 2)
+		runtimeError(0, a1, a2, a3);
+	else
+		scriptError(a1, a2, a3, a4);
+}
+
+#if COMPILE_PLAYER == 1
+int gamestate_size[MAX_CLIENTS] = {0};
+void hook_gamestate_info(const char *format, ...)
+{
+	HOOK_PROFILE(hook_gamestate_info);
+
+	char s[COD2_MAX_STRINGLENGTH];
+	va_list va;
+
+	va_start(va, format);
+	vsnprintf(s, sizeof(s), format, va);
+	va_end(va);
+
+	Com_DPrintf("%s", s);
+
+	char *tok;
+	int gamestate = 0;
+	int clientnum = 0;
+	tok = strtok(s, " ");
+
+	for (int i = 0; tok != NULL; i++)
+	{
+		if (i == 1)
+			gamestate = atoi(tok);
+		if (i == 7)
+			clientnum = atoi(tok);
+		tok = strtok(NULL, " ");
+	}
+
+	gamestate_size[clientnum] = gamestate;
+}
+
+int clientfps[MAX_CLIENTS] = {0};
+clientcmdstats_t clientcmdstats[MAX_CLIENTS];
+
+// Command rate and timing from svs.time and ucmd->serverTime, no syscalls per usercmd
+void SV_UpdateCmdStats(client_t *cl, usercmd_t *ucmd)
+{
+	int clientnum = cl - svs.clients;
+	clientcmdstats_t *stats = &clientcmdstats[clientnum];
+
+	if (stats->connectTime != cl->lastConnectTime || !stats->lastServerTime)
+	{
+		memset(stats, 0, sizeof(clientcmdstats_t));
+		stats->connectTime = cl->lastConnectTime;
+		stats->windowStart = svs.time;
+		stats->lastServerTime = ucmd->serverTime;
+		stats->driftMean = svs.time - ucmd->serverTime;
+		clientfps[clientnum] = 0;
+	}
+	else
+	{
+		int interval = ucmd->serverTime - stats->lastServerTime;
+
+		// Ignore serverTime resets (map_restart, timeouts)
+		if (interval >= 0 && interval < 1000)
+		{
+			float deviation = interval - stats->intervalMean;
+
+			stats->intervalMean += deviation / CMDSTATS_SMOOTHING;
+			stats->intervalJitter += (fabs(deviation) - stats->intervalJitter) / CMDSTATS_SMOOTHING;
+		}
+
+		stats->lastServerTime = ucmd->serverTime;
+	}
+
+	stats->drift = svs.time - ucmd->serverTime;
+	stats->driftMean += (stats->drift - stats->driftMean) / CMDSTATS_SMOOTHING;
+
+	stats->windowCommands++;
+
+	int elapsed = svs.time - stats->windowStart;
+
+	if (elapsed >= 1000)
+	{
+		clientfps[clientnum] = stats->windowCommands * 1000 / elapsed;
+
+		stats->fpsHistory[stats->fpsHistoryCount % CMDSTATS_HISTORY] = clientfps[clientnum];
+		stats->fpsHistoryCount++;
+
+		stats->windowStart = svs.time;
+		stats->windowCommands = 0;
+	}
+}
+
+int previousbuttons[MAX_CLIENTS] = {0};
+int buttonevents_pressed[MAX_CLIENTS] = {0};
+int buttonevents_released[MAX_CLIENTS] = {0};
+
+usercmdhistory_t usercmdhistory[MAX_CLIENTS];
+
+void SV_RecordUsercmd(client_t *cl, usercmd_t *ucmd)
+{
+	usercmdhistory_t *history = &usercmdhistory[cl - svs.clients];
+
+	if (history->connectTime != cl->lastConnectTime)
+	{
+		history->connectTime = cl->lastConnectTime;
+		history->count = 0;
+	}
+
+	history->cmds[history->count % USERCMD_HISTORY] = *ucmd;
+	history->count++;
+}
+
+aimstats_t aimstats[MAX_CLIENTS];
+
+// Player the view of cl points at within sv_aimSnapAngle degrees, aiming at head or body
+gentity_t *SV_AimSnapTarget(client_t *cl)
+{
+	gentity_t *self = cl->gentity;
+	playerState_t *ps = &self->client->ps;
+
+	float pitch = ps->viewangles[0] * (M_PI / 180);
+	float yaw = ps->viewangles[1] * (M_PI / 180);
+
+	vec3_t forward, eye;
+	VectorSet(forward, cos(pitch) * cos(yaw), cos(pitch) * sin(yaw), -sin(pitch));
+	VectorSet(eye, ps->origin[0], ps->origin[1], ps->origin[2] + ps->viewHeightCurrent);
+
+	float limit = cos(sv_aimSnapAngle->floatval * (M_PI / 180));
+
+	for (int i = 0; i < sv_maxclients->integer; i++)
+	{
+		client_t *other = &svs.clients[i];
+
+		if (other == cl || other->state != CS_ACTIVE || other->gentity == NULL || other->gentity->client == NULL)
+			continue;
+
+		gclient_t *target = other->gentity->client;
+
+		if (target->sess.state != STATE_PLAYING)
+			continue;
+
+		if (target->sess.team != TEAM_NONE && target->sess.team == self->client->sess.team)
+			continue;
+
+		for (int part = 0; part < 2; part++)
+		{
+			vec3_t dir;
+			float height = part == 0 ? target->ps.viewHeightCurrent : target->ps.viewHeightCurrent / 2;
+
+			VectorSet(dir, target->ps.origin[0] - eye[0], target->ps.origin[1] - eye[1], target->ps.origin[2] + height - eye[2]);
+
+			float length = sqrt(DotProduct(dir, dir));
+
+			if (length > 0 && DotProduct(forward, dir) / length >= limit)
+				return other->gentity;
+		}
+	}
+
+	return NULL;
+}
+
+// Angle deltas, acceleration and snaps: a fast turn that stops dead on an enemy
+void SV_UpdateAimStats(client_t *cl, usercmd_t *ucmd)
+{
+	int clientnum = cl - svs.clients;
+	aimstats_t *stats = &aimstats[clientnum];
 
-	va_start(va, format);
-	vsnprintf(s, COD2_MAX_STRINGLENGTH, format, va);
-	va_end(va);
+	if (stats->connectTime != cl->lastConnectTime)
+	{
+		memset(stats, 0, sizeof(aimstats_t));
+		stats->connectTime = cl->lastConnectTime;
+		stats->lastServerTime = ucmd->serverTime;
+		stats->lastAngles[0] = ucmd->angles[0];
+		stats->lastAngles[1] = ucmd->angles[1];
+		return;
+	}
 
-	s[COD2_MAX_STRINGLENGTH - 1] = '\0';
+	int dt = ucmd->serverTime - stats->lastServerTime;
 
-	return s;
+	if (dt <= 0)
+		return; // several commands in the same millisecond, compare against the next one
+
+	float pitch = SHORT2ANGLE((short)(ucmd->angles[0] - stats->lastAngles[0]));
+	float yaw = SHORT2ANGLE((short)(ucmd->angles[1] - stats->lastAngles[1]));
+	float delta = sqrt(pitch * pitch + yaw * yaw);
+	float velocity = delta * 1000 / dt;
+	float acceleration = fabs(velocity - stats->lastVelocity) * 1000 / dt;
+
+	stats->lastServerTime = ucmd->serverTime;
+	stats->lastAngles[0] = ucmd->angles[0];
+	stats->lastAngles[1] = ucmd->angles[1];
+
+	if (dt > 1000)
+	{
+		stats->lastVelocity = 0;
+		return; // serverTime reset
+	}
+
+	if (delta > stats->maxDelta)
+		stats->maxDelta = delta;
+
+	if (velocity > stats->maxVelocity)
+		stats->maxVelocity = velocity;
+
+	if (acceleration > stats->maxAcceleration)
+		stats->maxAcceleration = acceleration;
+
+	bool stopped = stats->lastVelocity >= sv_aimSnapSpeed->floatval && velocity < sv_aimSnapSpeed->floatval * 0.1;
+	stats->lastVelocity = velocity;
+
+	if (!stopped || cl->gentity == NULL || cl->gentity->client == NULL || cl->gentity->client->sess.state != STATE_PLAYING)
+		return;
+
+	gentity_t *target = SV_AimSnapTarget(cl);
+
+	if (target == NULL)
+		return;
+
+	stats->snapTimes[stats->snaps % AIMSTATS_SNAPS] = svs.time;
+	stats->snaps++;
+
+	if (codecallback_aimsnap && Scr_IsSystemActive() && svs.time - stats->lastCallbackTime >= AIMSTATS_CALLBACK_MSEC)
+	{
+		stats->lastCallbackTime = svs.time;
+
+		stackPushInt(stats->snaps);
+		stackPushEntity(target);
+		short ret = Scr_ExecEntThread(cl->gentity, codecallback_aimsnap, 2);
+		Scr_FreeThread(ret);
+	}
 }
 
-void hook_SV_VerifyIwds_f(client_t *cl)
+cHook *hook_play_movement;
+int play_movement(client_t *cl, usercmd_t *ucmd)
 {
-	if (sv_pure->boolean)
-		cl->pureAuthentic = 1;
+	HOOK_PROFILE(play_movement);
+
+	int (*sig)(client_t *cl, usercmd_t *ucmd);
+	*(int *)&sig = hook_play_movement->original();
+
+	int ret = sig(cl, ucmd);
+
+	hook_play_movement->rehook();
+
+	int clientnum = cl - svs.clients;
+
+	SV_UpdateCmdStats(cl, ucmd);
+	SV_RecordUsercmd(cl, ucmd);
+	SV_UpdateAimStats(cl, ucmd);
+
+	if (codecallback_buttonevents)
+	{
+		// Batched mode, delivered once per frame by SV_FlushButtonEvents()
+		buttonevents_pressed[clientnum] |= ucmd->buttons & ~previousbuttons[clientnum];
+		buttonevents_released[clientnum] |= previousbuttons[clientnum] & ~ucmd->buttons;
+
+		previousbuttons[clientnum] = ucmd->buttons;
+		return ret;
+	}
+
+	if(ucmd->buttons & KEY_MASK_MELEE && !(previousbuttons[clientnum] & KEY_MASK_MELEE))
+	{
+		if(codecallback_meleebutton)
+		{
+			short ret = Scr_ExecEntThread(cl->gentity, codecallback_meleebutton, 0);
+			Scr_FreeThread(ret);
+		}
+	}
+
+	if(ucmd->buttons & KEY_MASK_USE && !(previousbuttons[clientnum] & KEY_MASK_USE))
+	{
+		if(codecallback_usebutton)
+		{
+			short ret = Scr_ExecEntThread(cl->gentity, codecallback_usebutton, 0);
+			Scr_FreeThread(ret);
+		}
+	}
+
+	if(ucmd->buttons & KEY_MASK_FIRE && !(previousbuttons[clientnum] & KEY_MASK_FIRE))
+	{
+		if(codecallback_attackbutton)
+		{
+			short ret = Scr_ExecEntThread(cl->gentity, codecallback_attackbutton, 0);
+			Scr_FreeThread(ret);
+		}
+	}
+
+	previousbuttons[clientnum] = ucmd->buttons;
+	return ret;
 }
 
-void hook_SV_ResetPureClient_f(client_t *cl)
+// Calls CodeCallback_ButtonEvents(players, pressed, released) with the button
+// edges of every client since the last frame, instead of a thread per edge
+void SV_FlushButtonEvents()
 {
-	cl->pureAuthentic = 0;
+	int i;
+	int count = 0;
 
-	if (codecallback_vid_restart)
+	if (!codecallback_buttonevents)
+		return;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
 	{
-		if (!Scr_IsSystemActive())
-			return;
+		if (!buttonevents_pressed[i] && !buttonevents_released[i])
+			continue;
 
-		if (cl->gentity == NULL)
-			return;
+		if (svs.clients[i].state != CS_ACTIVE || svs.clients[i].gentity == NULL)
+		{
+			buttonevents_pressed[i] = buttonevents_released[i] = 0;
+			continue;
+		}
 
-		stackPushInt(cl - svs.clients);
-		short ret = Scr_ExecEntThread(cl->gentity, codecallback_vid_restart, 1);
-		Scr_FreeThread(ret);
+		count++;
+	}
+
+	if (!count)
+		return;
+
+	if (!Scr_IsSystemActive())
+	{
+		memset(buttonevents_pressed, 0, sizeof(buttonevents_pressed));
+		memset(buttonevents_released, 0, sizeof(buttonevents_released));
+		return;
+	}
+
+	stackPushArray();
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (buttonevents_pressed[i] || buttonevents_released[i])
+		{
+			stackPushInt(buttonevents_released[i]);
+			stackPushArrayLast();
+		}
+	}
+
+	stackPushArray();
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (buttonevents_pressed[i] || buttonevents_released[i])
+		{
+			stackPushInt(buttonevents_pressed[i]);
+			stackPushArrayLast();
+		}
+	}
+
+	stackPushArray();
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (buttonevents_pressed[i] || buttonevents_released[i])
+		{
+			stackPushEntity(svs.clients[i].gentity);
+			stackPushArrayLast();
+
+			buttonevents_pressed[i] = buttonevents_released[i] = 0;
+		}
+	}
+
+	short ret = Scr_ExecThread(codecallback_buttonevents, 3);
+	Scr_FreeThread(ret);
+}
+
+lagcomphistory_t lagcomphistory[MAX_CLIENTS];
+
+// One sample per server frame, a dead or spectating player is recorded as not playing
+void SV_RecordLagComp(gentity_t *ent)
+{
+	int num = ent - g_entities;
+	client_t *cl = &svs.clients[num];
+	lagcomphistory_t *history = &lagcomphistory[num];
+
+	if (history->connectTime != cl->lastConnectTime)
+	{
+		history->connectTime = cl->lastConnectTime;
+		history->count = 0;
 	}
+
+	lagcompsample_t *sample = &history->samples[history->count % LAGCOMP_HISTORY];
+
+	if (history->count > 0 && history->samples[(history->count - 1) % LAGCOMP_HISTORY].time == svs.time)
+		sample = &history->samples[(history->count - 1) % LAGCOMP_HISTORY]; // same frame, overwrite
+	else
+		history->count++;
+
+	sample->time = svs.time;
+	sample->playing = ent->client->sess.state == STATE_PLAYING ? qtrue : qfalse;
+	VectorCopy(ent->r.currentOrigin, sample->origin);
+	VectorCopy(ent->r.currentAngles, sample->angles);
+	VectorCopy(ent->r.mins, sample->mins);
+	VectorCopy(ent->r.maxs, sample->maxs);
+	sample->eFlags = ent->s.eFlags;
 }
 
-// Adds bot pings and removes spam on 1.2 and 1.3
-void custom_SV_CalcPings( void )
+int player_g_speed[MAX_CLIENTS] = {0};
+int player_g_gravity[MAX_CLIENTS] = {0};
+cHook *hook_play_endframe;
+int play_endframe(gentity_t *ent)
 {
-	int i, j;
-	client_t *cl;
-	int total, count;
-	int delta;
+	HOOK_PROFILE(play_endframe);
+
+	int (*sig)(gentity_t *ent);
+	*(int *)&sig = hook_play_endframe->original();
+
+	int ret = sig(ent);
+
+	hook_play_endframe->rehook();
+
+	SV_RecordLagComp(ent);
+
+	if (ent->client->sess.state == STATE_PLAYING)
+	{
+		int num = ent - g_entities;
+
+		if (player_g_speed[num] > 0)
+			ent->client->ps.speed = player_g_speed[num];
+
+		if (player_g_gravity[num] > 0)
+			ent->client->ps.gravity = player_g_gravity[num];
+	}
+
+	return ret;
+}
+
+int custom_animation[MAX_CLIENTS] = {0};
+cHook *hook_set_anim;
+int set_anim(playerState_t *ps, int animNum, animBodyPart_t bodyPart, int forceDuration, qboolean setTimer, qboolean isContinue, qboolean force)
+{
+	HOOK_PROFILE(set_anim);
+
+	int (*sig)(playerState_t *ps, int animNum, animBodyPart_t bodyPart, int forceDuration, qboolean setTimer, qboolean isContinue, qboolean force);
+	*(int *)&sig = hook_set_anim->original();
+
+	int ret;
+
+	if (!custom_animation[ps->clientNum])
+		ret = sig(ps, animNum, bodyPart, forceDuration, setTimer, isContinue, force);
+	else
+		ret = sig(ps, custom_animation[ps->clientNum], bodyPart, forceDuration, qtrue, isContinue, qtrue);
+
+	hook_set_anim->rehook();
+
+	return ret;
+}
+#endif
+
+#if COMPILE_RATELIMITER == 1
+// ioquake3 rate limit connectionless requests
+// https://github.com/ioquake/ioq3/blob/master/code/server/sv_main.c
+
+// This is deliberately quite large to make it more of an effort to DoS
+#define MAX_BUCKETS	16384
+#define MAX_HASHES 16384
+
+static leakyBucket_t buckets[ MAX_BUCKETS ];
+static leakyBucket_t* bucketHashes[ MAX_HASHES ];
+leakyBucket_t outboundLeakyBucket;
+
+// Buckets in use are kept in least recently used order and reclaimed from the cold
+// end once expired. Unused buckets sit on a free list. A bucket's expiry only ever
+// moves later, but buckets with different windows share the list, so the cold end
+// is not necessarily the first to expire: reclaim looks at a bounded number of
+// buckets and moves unexpired ones to the hot end instead of stopping at them.
+#define BUCKET_RECLAIM_SCAN 8
+static leakyBucket_t *bucketFree = NULL;
+static leakyBucket_t bucketLRU; // sentinel, lruNext is the most recently used
+static unsigned int bucketSeed;
+static bool bucketsInitialized = false;
+
+static void SVC_InitBuckets( void )
+{
+	int i;
+
+	memset( buckets, 0, sizeof( buckets ) );
+	memset( bucketHashes, 0, sizeof( bucketHashes ) );
+
+	bucketFree = NULL;
+
+	for ( i = MAX_BUCKETS - 1; i >= 0; i-- )
+	{
+		buckets[ i ].next = bucketFree;
+		bucketFree = &buckets[ i ];
+	}
+
+	bucketLRU.lruPrev = bucketLRU.lruNext = &bucketLRU;
+	bucketSeed = (unsigned int)time( NULL ) ^ ( (unsigned int)getpid() << 16 ) ^ (unsigned int)Sys_MilliSeconds();
+	bucketsInitialized = true;
+}
+
+static void SVC_MaskAddress( netadr_t address, int prefix, unsigned char *out )
+{
+	int i;
+
+	for ( i = 0; i < 4; i++ )
+	{
+		int bits = prefix - i * 8;
+
+		out[ i ] = bits >= 8 ? address.ip[ i ] : bits <= 0 ? 0 : address.ip[ i ] & ( 0xFF << ( 8 - bits ) );
+	}
+}
+
+// Seeded murmur3 finalizer, spoofed sources can not be picked to pile into one chain
+static long SVC_HashForAddress( netadr_t address, int prefix, int key )
+{
+	unsigned int hash;
+	unsigned char adr[ 4 ];
+
+	SVC_MaskAddress( address, prefix, adr );
+	memcpy( &hash, adr, 4 );
+
+	hash ^= bucketSeed + prefix + ( key << 8 );
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash & ( MAX_HASHES - 1 );
+}
+
+static void SVC_TouchBucket( leakyBucket_t *bucket )
+{
+	if ( bucket->lruPrev != NULL )
+	{
+		bucket->lruPrev->lruNext = bucket->lruNext;
+		bucket->lruNext->lruPrev = bucket->lruPrev;
+	}
+
+	bucket->lruPrev = &bucketLRU;
+	bucket->lruNext = bucketLRU.lruNext;
+	bucketLRU.lruNext->lruPrev = bucket;
+	bucketLRU.lruNext = bucket;
+}
+
+static void SVC_ReleaseBucket( leakyBucket_t *bucket )
+{
+	if ( bucket->prev != NULL )
+	{
+		bucket->prev->next = bucket->next;
+	}
+	else
+	{
+		bucketHashes[ bucket->hash ] = bucket->next;
+	}
+
+	if ( bucket->next != NULL )
+	{
+		bucket->next->prev = bucket->prev;
+	}
+
+	bucket->lruPrev->lruNext = bucket->lruNext;
+	bucket->lruNext->lruPrev = bucket->lruPrev;
+
+	memset( bucket, 0, sizeof( leakyBucket_t ) );
+
+	bucket->next = bucketFree;
+	bucketFree = bucket;
+}
+
+static leakyBucket_t *SVC_BucketForAddressAt( netadr_t address, int prefix, int key, int burst, int period, int now )
+{
+	leakyBucket_t *bucket = NULL;
+	unsigned char adr[ 4 ];
+	int	i, reclaimed;
+
+	if ( !bucketsInitialized )
+	{
+		SVC_InitBuckets();
+	}
+
+	long hash = SVC_HashForAddress( address, prefix, key );
+	SVC_MaskAddress( address, prefix, adr );
+
+	for ( bucket = bucketHashes[ hash ]; bucket; bucket = bucket->next )
+	{
+		if ( bucket->prefix == prefix && bucket->key == key && memcmp( bucket->adr, adr, 4 ) == 0 )
+		{
+			// Callers sharing a bucket may use different windows, never let a short
+			// one cut the expiry of a longer one that is still draining
+			if ( now + burst * period - bucket->expires > 0 )
+			{
+				bucket->expires = now + burst * period;
+			}
+
+			SVC_TouchBucket( bucket );
 
-	for ( i = 0 ; i < sv_maxclients->integer ; i++ )
+			return bucket;
+		}
+	}
+
+	// Reclaim expired buckets from the cold end, a couple per miss keeps up with any flood
+	for ( i = 0, reclaimed = 0; i < BUCKET_RECLAIM_SCAN && reclaimed < 2; i++ )
 	{
-		cl = &svs.clients[i];
+		leakyBucket_t *oldest = bucketLRU.lruPrev;
 
-		if ( cl->state != CS_ACTIVE )
+		if ( oldest == &bucketLRU )
 		{
-			cl->ping = -1;
-			continue;
+			break;
 		}
 
-		if ( !cl->gentity )
+		if ( now - oldest->expires < 0 && now - oldest->lastTime >= 0 )
 		{
-			cl->ping = -1;
+			// Still draining behind a longer window, don't let it hide expired ones
+			SVC_TouchBucket( oldest );
 			continue;
 		}
 
-		if ( cl->netchan.remoteAddress.type == NA_BOT )
-		{
-			cl->ping = 0;
-			cl->lastPacketTime = svs.time;
-			continue;
-		}
+		SVC_ReleaseBucket( oldest );
+		reclaimed++;
+	}
 
-		total = 0;
-		count = 0;
+	if ( bucketFree == NULL )
+	{
+		// Couldn't allocate a bucket for this address
+		return NULL;
+	}
 
-		for ( j = 0 ; j < PACKET_BACKUP ; j++ )
-		{
-			if ( cl->frames[j].messageAcked == 0xFFFFFFFF )
-				continue;
+	bucket = bucketFree;
+	bucketFree = bucket->next;
 
-			delta = cl->frames[j].messageAcked - cl->frames[j].messageSent;
-			count++;
-			total += delta;
-		}
+	bucket->type = address.type;
+	memcpy( bucket->adr, adr, 4 );
 
-		if ( !count )
-			cl->ping = 999;
-		else
-		{
-			cl->ping = total / count;
+	bucket->prefix = prefix;
+	bucket->key = key;
+	bucket->lastTime = now;
+	bucket->burst = 0;
+	bucket->hash = hash;
+	bucket->expires = now + burst * period;
 
-			if ( cl->ping > 999 )
-				cl->ping = 999;
-		}
+	// Add to the head of the relevant hash chain
+	bucket->next = bucketHashes[ hash ];
+	if ( bucketHashes[ hash ] != NULL )
+	{
+		bucketHashes[ hash ]->prev = bucket;
 	}
+
+	bucket->prev = NULL;
+	bucketHashes[ hash ] = bucket;
+
+	SVC_TouchBucket( bucket );
+
+	return bucket;
 }
 
-void custom_SV_CheckTimeouts( void )
+static leakyBucket_t *SVC_BucketForAddress( netadr_t address, int prefix, int key, int burst, int period )
 {
-	int	i;
-	client_t *cl;
-	int	droppoint;
-	int	zombiepoint;
+	return SVC_BucketForAddressAt( address, prefix, key, burst, period, Sys_MilliSeconds() );
+}
 
-	droppoint = svs.time - 1000 * sv_timeout->integer;
-	zombiepoint = svs.time - 1000 * sv_zombietime->integer;
+#define RATELIMIT_BENCHMARK_ADDRESSES 1000000
+#define RATELIMIT_BENCHMARK_MIXED ( MAX_BUCKETS * 4 )
+#define RATELIMIT_BENCHMARK_LONG 4
 
-	for ( i = 0, cl = svs.clients; i < sv_maxclients->integer; i++, cl++ )
-	{
-		// message times may be wrong across a changelevel
-		if (cl->lastPacketTime > svs.time)
-			cl->lastPacketTime = svs.time;
+// Replays a spoofed flood of distinct sources at 10 packets per millisecond of
+// simulated time and checks reclaiming with mixed windows, then restores the live buckets
+void SVC_BenchmarkRateLimit( void )
+{
+	netadr_t address;
+	int i, allocated = 0;
+	int start = Sys_MilliSeconds();
 
-		if (cl->state == CS_ZOMBIE && cl->lastPacketTime < zombiepoint)
+	// Over a million lookups on the game thread, don't stall anyone playing
+	for ( i = 0; i < sv_maxclients->integer; i++ )
+	{
+		if ( svs.clients[ i ].state >= CS_CONNECTED )
 		{
-			cl->state = CS_FREE; // can now be reused
-			continue;
+			Com_Printf( "ratelimit_benchmark: refused while clients are connected\n" );
+			return;
 		}
+	}
 
-		if (cl->state >= CS_CONNECTED && cl->lastPacketTime < droppoint)
+	// The simulated flood runs on the same table, the live one is set aside and
+	// put back as it was, protection carries on where it left off
+	leakyBucket_t *savedBuckets = (leakyBucket_t *)malloc( sizeof( buckets ) );
+	leakyBucket_t **savedHashes = (leakyBucket_t **)malloc( sizeof( bucketHashes ) );
+
+	if ( savedBuckets == NULL || savedHashes == NULL )
+	{
+		free( savedBuckets );
+		free( savedHashes );
+		Com_Printf( "ratelimit_benchmark: could not allocate a scratch table\n" );
+		return;
+	}
+
+	memcpy( savedBuckets, buckets, sizeof( buckets ) );
+	memcpy( savedHashes, bucketHashes, sizeof( bucketHashes ) );
+
+	leakyBucket_t *savedFree = bucketFree;
+	leakyBucket_t savedLRU = bucketLRU;
+	unsigned int savedSeed = bucketSeed;
+	bool savedInitialized = bucketsInitialized;
+
+	memset( &address, 0, sizeof( address ) );
+	address.type = NA_IP;
+
+	SVC_InitBuckets();
+
+	unsigned long long cycles = cracking_rdtsc();
+
+	for ( i = 0; i < RATELIMIT_BENCHMARK_ADDRESSES; i++ )
+	{
+		unsigned int ip = (unsigned int)i * 2654435761u; // odd multiplier, every address distinct
+
+		memcpy( address.ip, &ip, 4 );
+
+		if ( SVC_BucketForAddressAt( address, 32, 0, 10, 1000, start + i / 10 ) != NULL )
 		{
-			// wait several frames so a debugger session doesn't
-			// cause a timeout
-			if ( ++cl->timeoutCount > 5 )
-			{
-				SV_DropClient(cl, "EXE_TIMEDOUT");
-				cl->state = CS_FREE; // don't bother with zombie state
-			}
+			allocated++;
 		}
-		else
-			cl->timeoutCount = 0;
 	}
-}
 
-#if COMPILE_BOTS == 1
-int bot_buttons[MAX_CLIENTS] = {0};
-int bot_weapon[MAX_CLIENTS] = {0};
-char bot_forwardmove[MAX_CLIENTS] = {0};
-char bot_rightmove[MAX_CLIENTS] = {0};
-void custom_SV_BotUserMove(client_t *client)
-{
-	int num;
-	usercmd_t ucmd = {0};
+	cycles = cracking_rdtsc() - cycles;
 
-	if (client->gentity == NULL)
-		return;
+	Com_Printf( "ratelimit_benchmark: %d addresses, %.1f cycles per lookup, %d got a bucket, %d dropped\n",
+	            RATELIMIT_BENCHMARK_ADDRESSES, (double)cycles / RATELIMIT_BENCHMARK_ADDRESSES, allocated, RATELIMIT_BENCHMARK_ADDRESSES - allocated );
 
-	num = client - svs.clients;
-	ucmd.serverTime = svs.time;
+	// Mixed windows: a few long lived buckets sit at the cold end while short lived
+	// sources churn through at one per millisecond, far below what the table holds.
+	// Every lookup has to get a bucket, long windows must not block reclaiming.
+	SVC_InitBuckets();
 
-	playerState_t *ps = SV_GameClientNum(num);
-	gentity_t *ent = SV_GentityNum(num);
+	for ( i = 0; i < RATELIMIT_BENCHMARK_LONG; i++ )
+	{
+		unsigned int ip = 0xFFFFFFFFu - i;
 
-	if (bot_weapon[num])
-		ucmd.weapon = (byte)(bot_weapon[num] & 0xFF);
-	else
-		ucmd.weapon = (byte)(ps->weapon & 0xFF);
+		memcpy( address.ip, &ip, 4 );
+		SVC_BucketForAddressAt( address, 32, 0, 10, 60000, start );
+	}
 
-	if (ent->client == NULL)
-		return;
+	for ( i = 0, allocated = 0; i < RATELIMIT_BENCHMARK_MIXED; i++ )
+	{
+		unsigned int ip = (unsigned int)i * 2654435761u;
 
-	if (ent->client->sess.archiveTime == 0)
+		memcpy( address.ip, &ip, 4 );
+
+		if ( SVC_BucketForAddressAt( address, 32, 0, 1, 1000, start + i ) != NULL )
+		{
+			allocated++;
+		}
+	}
+
+	memcpy( buckets, savedBuckets, sizeof( buckets ) );
+	memcpy( bucketHashes, savedHashes, sizeof( bucketHashes ) );
+	bucketFree = savedFree;
+	bucketLRU = savedLRU;
+	bucketSeed = savedSeed;
+	bucketsInitialized = savedInitialized;
+
+	free( savedBuckets );
+	free( savedHashes );
+
+	Com_Printf( "ratelimit_benchmark: mixed windows %s, %d of %d got a bucket\n",
+	            allocated == RATELIMIT_BENCHMARK_MIXED ? "passed" : "FAILED", allocated, RATELIMIT_BENCHMARK_MIXED );
+}
+
+bool SVC_RateLimit( leakyBucket_t *bucket, int burst, int period )
+{
+	if ( bucket != NULL )
 	{
-		ucmd.buttons = bot_buttons[num];
+		int now = Sys_MilliSeconds();
+		int interval = now - bucket->lastTime;
+		int expired = interval / period;
+		int expiredRemainder = interval % period;
 
-		ucmd.forwardmove = bot_forwardmove[num];
-		ucmd.rightmove = bot_rightmove[num];
+		if ( expired > bucket->burst || interval < 0 )
+		{
+			bucket->burst = 0;
+			bucket->lastTime = now;
+		}
+		else
+		{
+			bucket->burst -= expired;
+			bucket->lastTime = now - expiredRemainder;
+		}
 
-		VectorCopy(ent->client->sess.cmd.angles, ucmd.angles);
+		if ( bucket->burst < burst )
+		{
+			bucket->burst++;
+
+			return false;
+		}
 	}
 
-	client->deltaMessage = client->netchan.outgoingSequence - 1;
-	SV_ClientThink(client, &ucmd);
+	return true;
 }
-#endif
 
-void hook_scriptError(int a1, int a2, int a3, void *a4)
+bool SVC_RateLimitPrefix( netadr_t from, int prefix, int key, int burst, int period )
 {
-	if (developer->integer == 2)
-		runtimeError(0, a1, a2, a3);
-	else
-		scriptError(a1, a2, a3, a4);
+	leakyBucket_t *bucket = SVC_BucketForAddress( from, prefix, key, burst, period );
+
+	return SVC_RateLimit( bucket, burst, period );
 }
 
-#if COMPILE_PLAYER == 1
-int gamestate_size[MAX_CLIENTS] = {0};
-void hook_gamestate_info(const char *format, ...)
+enum
 {
-	char s[COD2_MAX_STRINGLENGTH];
-	va_list va;
+	RATELIMIT_INFO,
+	RATELIMIT_STATUS,
+	RATELIMIT_CHALLENGE,
+	RATELIMIT_RCON,
+	RATELIMIT_COMMANDS
+};
 
-	va_start(va, format);
-	vsnprintf(s, sizeof(s), format, va);
-	va_end(va);
+enum
+{
+	RATELIMIT_DROP_ADDRESS,
+	RATELIMIT_DROP_SUBNET,
+	RATELIMIT_DROP_NETWORK,
+	RATELIMIT_DROP_OUTBOUND,
+	RATELIMIT_DROPS
+};
 
-	Com_DPrintf("%s", s);
+typedef struct
+{
+	const char *name;
+	const char *burstCvar;
+	const char *periodCvar;
+	cvar_t *burst;
+	cvar_t *period;
+	unsigned int accepted;
+	unsigned int dropped[ RATELIMIT_DROPS ];
+} ratelimit_t;
+
+static ratelimit_t ratelimits[ RATELIMIT_COMMANDS ] =
+{
+	{ "SVC_Info", "sv_rateLimitInfoBurst", "sv_rateLimitInfoPeriod" },
+	{ "SVC_Status", "sv_rateLimitStatusBurst", "sv_rateLimitStatusPeriod" },
+	{ "SV_GetChallenge", "sv_rateLimitChallengeBurst", "sv_rateLimitChallengePeriod" },
+	{ "SVC_RemoteCommand", "sv_rateLimitRconBurst", "sv_rateLimitRconPeriod" },
+};
 
-	char *tok;
-	int gamestate = 0;
-	int clientnum = 0;
-	tok = strtok(s, " ");
+static cvar_t *sv_rateLimitSubnetBurst;
+static cvar_t *sv_rateLimitNetworkBurst;
+static cvar_t *sv_rateLimitOutboundBurst;
+static cvar_t *sv_rateLimitOutboundPeriod;
+static cvar_t *sv_queryCacheTime;
+static cvar_t *sv_challengeCookies;
+static cvar_t *sv_floodThreshold;
+static cvar_t *sv_floodScale;
+static cvar_t *sv_floodCooldown;
+static cvar_t *sv_floodMode;
+static cvar_t *sv_badSourceThreshold;
+static cvar_t *sv_badSourceDecay;
+static cvar_t *sv_badSourceCapacity;
+static cvar_t *sv_badSourceFalsePositive;
+
+void SVC_RegisterRateLimits( void )
+{
+	int i;
 
-	for (int i = 0; tok != NULL; i++)
+	for ( i = 0; i < RATELIMIT_COMMANDS; i++ )
 	{
-		if (i == 1)
-			gamestate = atoi(tok);
-		if (i == 7)
-			clientnum = atoi(tok);
-		tok = strtok(NULL, " ");
+		ratelimits[ i ].burst = Cvar_RegisterFloat( ratelimits[ i ].burstCvar, 10.0, 1.0, 1000.0, CVAR_ARCHIVE );
+		ratelimits[ i ].period = Cvar_RegisterFloat( ratelimits[ i ].periodCvar, 1000.0, 1.0, 60000.0, CVAR_ARCHIVE );
 	}
 
-	gamestate_size[clientnum] = gamestate;
+	// Aggregates over /24 and /16 catch floods rotating through neighbouring sources, 0 = off
+	sv_rateLimitSubnetBurst = Cvar_RegisterFloat( "sv_rateLimitSubnetBurst", 0.0, 0.0, 10000.0, CVAR_ARCHIVE );
+	sv_rateLimitNetworkBurst = Cvar_RegisterFloat( "sv_rateLimitNetworkBurst", 0.0, 0.0, 10000.0, CVAR_ARCHIVE );
+	sv_rateLimitOutboundBurst = Cvar_RegisterFloat( "sv_rateLimitOutboundBurst", 10.0, 1.0, 1000.0, CVAR_ARCHIVE );
+	sv_rateLimitOutboundPeriod = Cvar_RegisterFloat( "sv_rateLimitOutboundPeriod", 100.0, 1.0, 60000.0, CVAR_ARCHIVE );
+
+	// How long a built getinfo/getstatus response is replayed, 0 = build every time
+	sv_queryCacheTime = Cvar_RegisterFloat( "sv_queryCacheTime", 1000.0, 0.0, 60000.0, CVAR_ARCHIVE );
+
+	// Answer getchallenge from clients that skip authorization with a keyed hash instead of a table entry, 1.0 only
+	sv_challengeCookies = Cvar_RegisterBool( "sv_challengeCookies", qfalse, CVAR_ARCHIVE );
+
+	// Above sv_floodThreshold connectionless packets per second all limits are divided by sv_floodScale
+	sv_floodThreshold = Cvar_RegisterFloat( "sv_floodThreshold", 1000.0, 0.0, 1000000.0, CVAR_ARCHIVE );
+	sv_floodScale = Cvar_RegisterFloat( "sv_floodScale", 4.0, 1.0, 100.0, CVAR_ARCHIVE );
+	sv_floodCooldown = Cvar_RegisterFloat( "sv_floodCooldown", 10.0, 1.0, 3600.0, CVAR_ARCHIVE );
+	sv_floodMode = Cvar_RegisterString( "sv_floodMode", "0", CVAR_ROM );
+
+	// Sources dropped by their address bucket sv_badSourceThreshold times are dropped up front, 0 = off
+	sv_badSourceThreshold = Cvar_RegisterFloat( "sv_badSourceThreshold", 20.0, 0.0, 255.0, CVAR_ARCHIVE );
+	sv_badSourceDecay = Cvar_RegisterFloat( "sv_badSourceDecay", 10000.0, 1000.0, 600000.0, CVAR_ARCHIVE );
+	sv_badSourceCapacity = Cvar_RegisterFloat( "sv_badSourceCapacity", 65536.0, 1024.0, 1048576.0, CVAR_ARCHIVE );
+	sv_badSourceFalsePositive = Cvar_RegisterFloat( "sv_badSourceFalsePositive", 0.001, 0.000001, 0.5, CVAR_ARCHIVE );
 }
 
-int clientfps[MAX_CLIENTS] = {0};
-int tempfps[MAX_CLIENTS] = {0};
-int fpstime[MAX_CLIENTS] = {0};
-
-int previousbuttons[MAX_CLIENTS] = {0};
-
-cHook *hook_play_movement;
-int play_movement(client_t *cl, usercmd_t *ucmd)
+/*
+	Flood mode: inbound connectionless packets are counted per second. Crossing
+	sv_floodThreshold tightens every limit, it is left once the rate stayed below half the
+	threshold for sv_floodCooldown seconds.
+*/
+static bool floodMode = false;
+static int floodWindowStart = 0;
+static int floodWindowPackets = 0;
+static int floodCalmSince = 0;
+
+static void SVC_UpdateFloodMode( void )
 {
-	hook_play_movement->unhook();
+	int now = Sys_MilliSeconds();
+	int elapsed = now - floodWindowStart;
 
-	int (*sig)(client_t *cl, usercmd_t *ucmd);
-	*(int *)&sig = hook_play_movement->from;
+	floodWindowPackets++;
 
-	int ret = sig(cl, ucmd);
+	if ( elapsed < 1000 && elapsed >= 0 )
+		return;
 
-	hook_play_movement->hook();
+	int rate = elapsed > 0 ? (int)( (long long)floodWindowPackets * 1000 / elapsed ) : 0;
+	int threshold = (int)sv_floodThreshold->floatval;
 
-	int clientnum = cl - svs.clients;
+	int windowStart = floodWindowStart;
 
-	tempfps[clientnum]++;
+	floodWindowStart = now;
+	floodWindowPackets = 0;
 
-	if (Sys_MilliSeconds() >= (fpstime[clientnum] + 1000))
+	if ( threshold <= 0 )
 	{
-		clientfps[clientnum] = tempfps[clientnum];
-		fpstime[clientnum] = Sys_MilliSeconds();
-		tempfps[clientnum] = 0;
+		rate = 0; // disabled, let an active flood mode cool down
+		threshold = 1;
 	}
 
-	if(ucmd->buttons & KEY_MASK_MELEE && !(previousbuttons[clientnum] & KEY_MASK_MELEE))
+	if ( !floodMode && rate >= threshold )
 	{
-		if(codecallback_meleebutton)
-		{
-			short ret = Scr_ExecEntThread(cl->gentity, codecallback_meleebutton, 0);
-			Scr_FreeThread(ret);
-		}
+		floodMode = true;
+		floodCalmSince = 0;
+		Cvar_SetString( sv_floodMode, "1" );
+		Com_Printf( "Connectionless flood: %d packets/s, tightening rate limits by %g\n", rate, sv_floodScale->floatval );
 	}
-
-	if(ucmd->buttons & KEY_MASK_USE && !(previousbuttons[clientnum] & KEY_MASK_USE))
+	else if ( floodMode )
 	{
-		if(codecallback_usebutton)
+		if ( rate >= threshold / 2 )
 		{
-			short ret = Scr_ExecEntThread(cl->gentity, codecallback_usebutton, 0);
-			Scr_FreeThread(ret);
+			floodCalmSince = 0;
 		}
-	}
-
-	if(ucmd->buttons & KEY_MASK_FIRE && !(previousbuttons[clientnum] & KEY_MASK_FIRE))
-	{
-		if(codecallback_attackbutton)
+		else if ( floodCalmSince == 0 )
 		{
-			short ret = Scr_ExecEntThread(cl->gentity, codecallback_attackbutton, 0);
-			Scr_FreeThread(ret);
+			floodCalmSince = windowStart; // quiet since this window began
+		}
+		else if ( now - floodCalmSince >= (int)( sv_floodCooldown->floatval * 1000 ) )
+		{
+			floodMode = false;
+			Cvar_SetString( sv_floodMode, "0" );
+			Com_Printf( "Connectionless flood over: %d packets/s, rate limits back to normal\n", rate );
 		}
 	}
-
-	previousbuttons[clientnum] = ucmd->buttons;
-	return ret;
 }
 
-int player_g_speed[MAX_CLIENTS] = {0};
-int player_g_gravity[MAX_CLIENTS] = {0};
-cHook *hook_play_endframe;
-int play_endframe(gentity_t *ent)
+static int SVC_FloodBurst( float burst )
 {
-	hook_play_endframe->unhook();
+	if ( floodMode )
+		burst /= sv_floodScale->floatval;
 
-	int (*sig)(gentity_t *ent);
-	*(int *)&sig = hook_play_endframe->from;
+	return burst < 1 ? 1 : (int)burst;
+}
 
-	int ret = sig(ent);
+/*
+	Sources that keep tripping their address bucket are remembered in a counting bloom
+	filter, later packets from them are dropped after k counter reads without touching a
+	bucket. All counters are halved every sv_badSourceDecay milliseconds, so a source that
+	stops misbehaving falls out after a few periods. The filter is sized for
+	sv_badSourceCapacity sources at a false positive rate of sv_badSourceFalsePositive.
+	That rate is fill^k, with fill the share of counters at the threshold. A flood of more
+	sources than the filter was sized for pushes the fill past p^(1/k), from there on
+	early drops are skipped until decay brings the fill back down.
+*/
+#define MAX_BADSOURCE_COUNTERS ( 1 << 25 )
+#define MAX_BADSOURCE_HASHES 16
+
+static unsigned char *badSourceCounters = NULL;
+static unsigned int badSourceMask = 0;
+static int badSourceHashes = 0;
+static unsigned int badSourceSeed;
+static int badSourceDecayTime = 0;
+static int badSourceCapacity = 0;
+static float badSourceFalsePositive = 0;
+static unsigned int badSourceDropped = 0;
+static unsigned int badSourceFilled = 0; // counters at or above the threshold
+static unsigned int badSourceSaturation = 0; // fill count where false positives pass the design rate
+static int badSourceThreshold = 0;
+
+static void SVC_ResizeBadSources( void )
+{
+	badSourceCapacity = (int)sv_badSourceCapacity->floatval;
+	badSourceFalsePositive = sv_badSourceFalsePositive->floatval;
+
+	// m = -n ln p / ln(2)^2, rounded up to a power of two, then k = m / n ln 2
+	double counters = -badSourceCapacity * log( badSourceFalsePositive ) / ( M_LN2 * M_LN2 );
+	unsigned int size = 1024;
+
+	while ( size < counters && size < MAX_BADSOURCE_COUNTERS )
+		size <<= 1;
+
+	badSourceHashes = (int)( (double)size / badSourceCapacity * M_LN2 + 0.5 );
+
+	if ( badSourceHashes < 1 )
+		badSourceHashes = 1;
+	else if ( badSourceHashes > MAX_BADSOURCE_HASHES )
+		badSourceHashes = MAX_BADSOURCE_HASHES;
+
+	free( badSourceCounters );
+	badSourceCounters = (unsigned char *)calloc( size, 1 );
+	badSourceMask = size - 1;
+	badSourceFilled = 0;
+	badSourceSaturation = (unsigned int)( pow( badSourceFalsePositive, 1.0 / badSourceHashes ) * size );
+	badSourceSeed = (unsigned int)time( NULL ) ^ ( (unsigned int)getpid() << 16 ) ^ (unsigned int)cracking_rdtsc();
+	badSourceDecayTime = Sys_MilliSeconds();
+}
 
-	hook_play_endframe->hook();
+static void SVC_CountBadSources( void )
+{
+	badSourceFilled = 0;
 
-	if (ent->client->sess.state == STATE_PLAYING)
+	for ( unsigned int i = 0; i <= badSourceMask; i++ )
 	{
-		int num = ent - g_entities;
-
-		if (player_g_speed[num] > 0)
-			ent->client->ps.speed = player_g_speed[num];
-
-		if (player_g_gravity[num] > 0)
-			ent->client->ps.gravity = player_g_gravity[num];
+		if ( badSourceCounters[ i ] >= badSourceThreshold )
+			badSourceFilled++;
 	}
-
-	return ret;
 }
 
-int custom_animation[MAX_CLIENTS] = {0};
-cHook *hook_set_anim;
-int set_anim(playerState_t *ps, int animNum, animBodyPart_t bodyPart, int forceDuration, qboolean setTimer, qboolean isContinue, qboolean force)
+static void SVC_UpdateBadSources( void )
 {
-	hook_set_anim->unhook();
+	if ( sv_badSourceThreshold->floatval < 1 )
+	{
+		free( badSourceCounters );
+		badSourceCounters = NULL;
+		return;
+	}
 
-	int (*sig)(playerState_t *ps, int animNum, animBodyPart_t bodyPart, int forceDuration, qboolean setTimer, qboolean isContinue, qboolean force);
-	*(int *)&sig = hook_set_anim->from;
+	if ( badSourceCounters == NULL || badSourceCapacity != (int)sv_badSourceCapacity->floatval || badSourceFalsePositive != sv_badSourceFalsePositive->floatval )
+		SVC_ResizeBadSources();
 
-	int ret;
+	if ( badSourceThreshold != (int)sv_badSourceThreshold->floatval )
+	{
+		badSourceThreshold = (int)sv_badSourceThreshold->floatval;
+		SVC_CountBadSources();
+	}
 
-	if (!custom_animation[ps->clientNum])
-		ret = sig(ps, animNum, bodyPart, forceDuration, setTimer, isContinue, force);
-	else
-		ret = sig(ps, custom_animation[ps->clientNum], bodyPart, forceDuration, qtrue, isContinue, qtrue);
+	int now = Sys_MilliSeconds();
+
+	if ( now - badSourceDecayTime < (int)sv_badSourceDecay->floatval )
+		return;
+
+	// Halve four counters at a time
+	unsigned int *words = (unsigned int *)badSourceCounters;
 
-	hook_set_anim->hook();
+	for ( unsigned int i = 0; i <= badSourceMask / 4; i++ )
+		words[ i ] = ( words[ i ] >> 1 ) & 0x7F7F7F7F;
 
-	return ret;
+	SVC_CountBadSources();
+	badSourceDecayTime = now;
 }
-#endif
-
-#if COMPILE_RATELIMITER == 1
-// ioquake3 rate limit connectionless requests
-// https://github.com/ioquake/ioq3/blob/master/code/server/sv_main.c
 
-// This is deliberately quite large to make it more of an effort to DoS
-#define MAX_BUCKETS	16384
-#define MAX_HASHES 1024
+// Two seeded murmur3 finalizers, the k indexes are derived by double hashing
+static void SVC_BadSourceHashes( netadr_t from, unsigned int *h1, unsigned int *h2 )
+{
+	unsigned int hash;
 
-static leakyBucket_t buckets[ MAX_BUCKETS ];
-static leakyBucket_t* bucketHashes[ MAX_HASHES ];
-leakyBucket_t outboundLeakyBucket;
+	memcpy( &hash, from.ip, 4 );
 
-static long SVC_HashForAddress( netadr_t address )
-{
-	unsigned char *ip = address.ip;
-	int	i;
-	long hash = 0;
+	hash ^= badSourceSeed;
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
 
-	for ( i = 0; i < 4; i++ )
-	{
-		hash += (long)( ip[ i ] ) * ( i + 119 );
-	}
+	*h1 = hash;
 
-	hash = ( hash ^ ( hash >> 10 ) ^ ( hash >> 20 ) );
-	hash &= ( MAX_HASHES - 1 );
+	hash ^= 0x9e3779b9;
+	hash *= 0xcc9e2d51;
+	hash ^= hash >> 15;
+	hash *= 0x1b873593;
+	hash ^= hash >> 16;
 
-	return hash;
+	*h2 = hash | 1;
 }
 
-static leakyBucket_t *SVC_BucketForAddress( netadr_t address, int burst, int period )
+static void SVC_MarkBadSource( netadr_t from )
 {
-	leakyBucket_t *bucket = NULL;
-	int	i;
-	long hash = SVC_HashForAddress( address );
-	int	now = Sys_MilliSeconds();
+	unsigned int h1, h2;
+	int i;
 
-	for ( bucket = bucketHashes[ hash ]; bucket; bucket = bucket->next )
-	{
-		if ( memcmp( bucket->adr, address.ip, 4 ) == 0 )
-		{
-			return bucket;
-		}
-	}
+	if ( badSourceCounters == NULL )
+		return;
+
+	SVC_BadSourceHashes( from, &h1, &h2 );
 
-	for ( i = 0; i < MAX_BUCKETS; i++ )
+	for ( i = 0; i < badSourceHashes; i++ )
 	{
-		int interval;
+		unsigned char *counter = &badSourceCounters[ ( h1 + i * h2 ) & badSourceMask ];
 
-		bucket = &buckets[ i ];
-		interval = now - bucket->lastTime;
+		if ( *counter < 255 && ++( *counter ) == badSourceThreshold )
+			badSourceFilled++;
+	}
+}
 
-		// Reclaim expired buckets
-		if ( bucket->lastTime > 0 && ( interval > ( burst * period ) ||
-		                               interval < 0 ) )
-		{
-			if ( bucket->prev != NULL )
-			{
-				bucket->prev->next = bucket->next;
-			}
-			else
-			{
-				bucketHashes[ bucket->hash ] = bucket->next;
-			}
+static bool SVC_IsBadSource( netadr_t from )
+{
+	unsigned int h1, h2;
+	int i;
 
-			if ( bucket->next != NULL )
-			{
-				bucket->next->prev = bucket->prev;
-			}
+	if ( badSourceCounters == NULL )
+		return false;
 
-			memset( bucket, 0, sizeof( leakyBucket_t ) );
-		}
+	// Saturated, too many innocent sources would match
+	if ( badSourceFilled > badSourceSaturation )
+		return false;
 
-		if ( bucket->type == 0 )
-		{
-			bucket->type = address.type;
-			memcpy( bucket->adr, address.ip, 4 );
+	SVC_BadSourceHashes( from, &h1, &h2 );
 
-			bucket->lastTime = now;
-			bucket->burst = 0;
-			bucket->hash = hash;
+	for ( i = 0; i < badSourceHashes; i++ )
+	{
+		if ( badSourceCounters[ ( h1 + i * h2 ) & badSourceMask ] < badSourceThreshold )
+			return false;
+	}
 
-			// Add to the head of the relevant hash chain
-			bucket->next = bucketHashes[ hash ];
-			if ( bucketHashes[ hash ] != NULL )
-			{
-				bucketHashes[ hash ]->prev = bucket;
-			}
+	return true;
+}
 
-			bucket->prev = NULL;
-			bucketHashes[ hash ] = bucket;
+// Returns true when the request should be dropped, counting what dropped it
+static bool SVC_RateLimitRequest( int command, netadr_t from, bool outbound )
+{
+	ratelimit_t *limit = &ratelimits[ command ];
+	int burst = SVC_FloodBurst( limit->burst->floatval );
+	int period = (int)limit->period->floatval;
+	int reason = -1;
+
+	// Each request kind has its own address bucket, so status polls can't use up
+	// the budget for challenges. The aggregates are shared by all of them.
+	if ( SVC_RateLimitPrefix( from, 32, command + 1, burst, period ) )
+	{
+		reason = RATELIMIT_DROP_ADDRESS;
+	}
+	else if ( sv_rateLimitSubnetBurst->floatval > 0 && SVC_RateLimitPrefix( from, 24, 0, SVC_FloodBurst( sv_rateLimitSubnetBurst->floatval ), period ) )
+	{
+		reason = RATELIMIT_DROP_SUBNET;
+	}
+	else if ( sv_rateLimitNetworkBurst->floatval > 0 && SVC_RateLimitPrefix( from, 16, 0, SVC_FloodBurst( sv_rateLimitNetworkBurst->floatval ), period ) )
+	{
+		reason = RATELIMIT_DROP_NETWORK;
+	}
+	else if ( outbound && SVC_RateLimit( &outboundLeakyBucket, SVC_FloodBurst( sv_rateLimitOutboundBurst->floatval ), (int)sv_rateLimitOutboundPeriod->floatval ) )
+	{
+		reason = RATELIMIT_DROP_OUTBOUND;
+	}
 
-			return bucket;
-		}
+	if ( reason == -1 )
+	{
+		limit->accepted++;
+		return false;
 	}
 
-	// Couldn't allocate a bucket for this address
-	return NULL;
+	limit->dropped[ reason ]++;
+
+	// Only the address's own bucket marks it, aggregates and the outbound budget are shared
+	if ( reason == RATELIMIT_DROP_ADDRESS )
+		SVC_MarkBadSource( from );
+
+	if ( reason == RATELIMIT_DROP_OUTBOUND )
+		Com_DPrintf( "%s: rate limit exceeded, dropping request\n", limit->name );
+	else
+		Com_DPrintf( "%s: rate limit from %s exceeded, dropping request\n", limit->name, NET_AdrToString( from ) );
+
+	return true;
 }
 
-bool SVC_RateLimit( leakyBucket_t *bucket, int burst, int period )
+// Console command, so it can be read over rcon while tuning the limits
+void SVC_RateLimitStats( void )
 {
-	if ( bucket != NULL )
-	{
-		int now = Sys_MilliSeconds();
-		int interval = now - bucket->lastTime;
-		int expired = interval / period;
-		int expiredRemainder = interval % period;
+	int i, j, used = MAX_BUCKETS;
+	leakyBucket_t *bucket;
 
-		if ( expired > bucket->burst || interval < 0 )
-		{
-			bucket->burst = 0;
-			bucket->lastTime = now;
-		}
-		else
+	if ( Cmd_Argc() > 1 && strcmp( Cmd_Argv( 1 ), "reset" ) == 0 )
+	{
+		for ( i = 0; i < RATELIMIT_COMMANDS; i++ )
 		{
-			bucket->burst -= expired;
-			bucket->lastTime = now - expiredRemainder;
+			ratelimits[ i ].accepted = 0;
+
+			for ( j = 0; j < RATELIMIT_DROPS; j++ )
+				ratelimits[ i ].dropped[ j ] = 0;
 		}
 
-		if ( bucket->burst < burst )
-		{
-			bucket->burst++;
+		badSourceDropped = 0;
 
-			return false;
-		}
+		Com_Printf( "ratelimit_stats: counters reset\n" );
+		return;
 	}
 
-	return true;
-}
+	for ( bucket = bucketFree; bucket; bucket = bucket->next )
+		used--;
 
-bool SVC_RateLimitAddress( netadr_t from, int burst, int period )
-{
-	leakyBucket_t *bucket = SVC_BucketForAddress( from, burst, period );
+	Com_Printf( "%-18s %10s %10s %10s %10s %10s\n", "request", "accepted", "address", "/24", "/16", "outbound" );
 
-	return SVC_RateLimit( bucket, burst, period );
+	for ( i = 0; i < RATELIMIT_COMMANDS; i++ )
+	{
+		ratelimit_t *limit = &ratelimits[ i ];
+
+		Com_Printf( "%-18s %10u %10u %10u %10u %10u\n", limit->name, limit->accepted, limit->dropped[ RATELIMIT_DROP_ADDRESS ],
+		            limit->dropped[ RATELIMIT_DROP_SUBNET ], limit->dropped[ RATELIMIT_DROP_NETWORK ], limit->dropped[ RATELIMIT_DROP_OUTBOUND ] );
+	}
+
+	Com_Printf( "buckets in use: %d of %d, flood mode %s\n", bucketsInitialized ? used : 0, MAX_BUCKETS, floodMode ? "on" : "off" );
+
+	if ( badSourceCounters != NULL )
+	{
+		Com_Printf( "bad sources dropped: %u, filter %u counters x %d hashes\n", badSourceDropped, badSourceMask + 1, badSourceHashes );
+		Com_Printf( "filter fill: %.2f%% of %.2f%%%s\n", 100.0 * badSourceFilled / ( badSourceMask + 1 ),
+		            100.0 * badSourceSaturation / ( badSourceMask + 1 ), badSourceFilled > badSourceSaturation ? ", saturated, early drops off" : "" );
+	}
+	else
+		Com_Printf( "bad source filter off\n" );
 }
 
 bool isRconCommandWithForwardedOutput(const char* command)
@@ -1059,15 +3051,14 @@ bool isRconCommandWithForwardedOutput(const char* command)
 
 void hook_SVC_RemoteCommand(netadr_t from, msg_t *msg)
 {
+	HOOK_PROFILE(hook_SVC_RemoteCommand);
+
 	if (!sv_allowRcon->boolean)
 		return;
 
 	// Prevent using rcon as an amplifier and make dictionary attacks impractical
-	if ( SVC_RateLimitAddress( from, 10, 1000 ) )
-	{
-		Com_DPrintf( "SVC_RemoteCommand: rate limit from %s exceeded, dropping request\n", NET_AdrToString( from ) );
+	if ( SVC_RateLimitRequest( RATELIMIT_RCON, from, false ) )
 		return;
-	}
 
 	bool badRconPassword = !strlen( rcon_password->string ) || strcmp(Cmd_Argv(1), rcon_password->string) != 0;
 	if (badRconPassword)
@@ -1107,64 +3098,398 @@ void hook_SVC_RemoteCommand(netadr_t from, msg_t *msg)
 	}
 }
 
-void hook_SV_GetChallenge(netadr_t from)
+/*
+	getinfo/getstatus responses are built by the engine at most every sv_queryCacheTime
+	ms, or sooner when a player joins or leaves. NET_OutOfBandPrint stays hooked, while a
+	response is built its reply is captured instead of sent, later requesters get the same
+	packet with their own challenge spliced in.
+*/
+#define QUERY_RESPONSE_LENGTH 16384
+
+enum
+{
+	QUERY_INFO,
+	QUERY_STATUS,
+	QUERY_TYPES
+};
+
+typedef struct
+{
+	bool valid;
+	int time;
+	unsigned int players;
+	int captures;
+	netsrc_t sock;
+	int length;
+	int challengeStart, challengeEnd; // challenge value in response
+	char response[QUERY_RESPONSE_LENGTH];
+} queryresponse_t;
+
+static queryresponse_t queryResponses[ QUERY_TYPES ];
+static queryresponse_t *queryCapture = NULL;
+static cHook *hook_queryCapture = NULL;
+
+static void SVC_CaptureOutOfBandPrint( netsrc_t sock, netadr_t adr, const char *format, ... )
 {
-	// Prevent using getchallenge as an amplifier
-	if ( SVC_RateLimitAddress( from, 10, 1000 ) )
+	HOOK_PROFILE(SVC_CaptureOutOfBandPrint);
+
+	va_list va;
+
+	if ( queryCapture != NULL )
 	{
-		Com_DPrintf( "SV_GetChallenge: rate limit from %s exceeded, dropping request\n", NET_AdrToString( from ) );
+		va_start( va, format );
+		queryCapture->length = vsnprintf( queryCapture->response, sizeof( queryCapture->response ), format, va );
+		va_end( va );
+
+		queryCapture->sock = sock;
+		queryCapture->captures++;
 		return;
 	}
 
-	// Allow getchallenge to be DoSed relatively easily, but prevent
-	// excess outbound bandwidth usage when being flooded inbound
-	if ( SVC_RateLimit( &outboundLeakyBucket, 10, 100 ) )
+	// Varargs can't be passed on, the original gets the formatted string
+	static char string[ MAX_MSGLEN ];
+
+	va_start( va, format );
+	vsnprintf( string, sizeof( string ), format, va );
+	va_end( va );
+
+	void (*sig)(netsrc_t sock, netadr_t adr, const char *format, ...);
+	*(int *)&sig = hook_queryCapture->original();
+
+	sig( sock, adr, "%s", string );
+
+	hook_queryCapture->rehook();
+}
+
+// Changes whenever a slot is taken or freed
+static unsigned int SVC_QueryPlayers( void )
+{
+	unsigned int players = 2166136261u;
+	int i;
+
+	for ( i = 0; i < sv_maxclients->integer; i++ )
 	{
-		Com_DPrintf( "SV_GetChallenge: rate limit exceeded, dropping request\n" );
-		return;
+		if ( svs.clients[ i ].state >= CS_CONNECTED )
+			players = ( players ^ ( i + 1 ) ^ svs.clients[ i ].lastConnectTime ) * 16777619u;
 	}
 
-	SV_GetChallenge(from);
+	return players;
 }
 
-void hook_SVC_Info(netadr_t from)
+static void SVC_QueryCached( int type, netadr_t from, void ( *build )( netadr_t from ) )
 {
-	// Prevent using getinfo as an amplifier
-	if ( SVC_RateLimitAddress( from, 10, 1000 ) )
+	queryresponse_t *cache = &queryResponses[ type ];
+	const char *challenge = Cmd_Argv( 1 );
+	int challengeLength = strlen( challenge );
+	int cacheTime = (int)sv_queryCacheTime->floatval;
+
+	// Anything the engine might treat specially goes the slow way
+	if ( cacheTime <= 0 || challengeLength == 0 || challengeLength > 128 || strpbrk( challenge, "\\;\"\n" ) != NULL )
 	{
-		Com_DPrintf( "SVC_Info: rate limit from %s exceeded, dropping request\n", NET_AdrToString( from ) );
+		build( from );
 		return;
 	}
 
-	// Allow getinfo to be DoSed relatively easily, but prevent
-	// excess outbound bandwidth usage when being flooded inbound
-	if ( SVC_RateLimit( &outboundLeakyBucket, 10, 100 ) )
+	int now = Sys_MilliSeconds();
+	unsigned int players = SVC_QueryPlayers();
+
+	if ( !cache->valid || now - cache->time >= cacheTime || now - cache->time < 0 || cache->players != players )
 	{
-		Com_DPrintf( "SVC_Info: rate limit exceeded, dropping request\n" );
+		cache->valid = false;
+		cache->captures = 0;
+
+		queryCapture = cache;
+		build( from );
+		queryCapture = NULL;
+
+		if ( cache->captures == 0 )
+			return; // the engine did not reply
+
+		if ( cache->captures == 1 && cache->length > 0 && cache->length < (int)sizeof( cache->response ) )
+		{
+			char *value = strstr( cache->response, "\\challenge\\" );
+
+			if ( value != NULL )
+			{
+				value += strlen( "\\challenge\\" );
+
+				cache->challengeStart = value - cache->response;
+				cache->challengeEnd = cache->challengeStart + strcspn( value, "\\\n" );
+				cache->time = now;
+				cache->players = players;
+				cache->valid = true;
+			}
+		}
+
+		// The capture swallowed the reply, send it now
+		NET_OutOfBandPrint( cache->sock, from, "%s", cache->response );
 		return;
 	}
 
-	SVC_Info(from);
+	char response[ QUERY_RESPONSE_LENGTH + 128 ];
+	int length = cache->challengeStart;
+
+	memcpy( response, cache->response, length );
+	memcpy( &response[ length ], challenge, challengeLength );
+	length += challengeLength;
+	memcpy( &response[ length ], &cache->response[ cache->challengeEnd ], cache->length - cache->challengeEnd + 1 );
+
+	NET_OutOfBandPrint( cache->sock, from, "%s", response );
 }
 
-void hook_SVC_Status(netadr_t from)
+void SVC_InfoCached( netadr_t from )
+{
+	SVC_QueryCached( QUERY_INFO, from, SVC_Info );
+}
+
+void SVC_StatusCached( netadr_t from )
+{
+	SVC_QueryCached( QUERY_STATUS, from, SVC_Status );
+}
+
+/*
+	Challenge cookies: the challenge handed out is SipHash-2-4 over the source address,
+	port and a time window, keyed with a secret drawn at startup. getchallenge keeps no
+	state. A connect carrying a cookie of the current or previous window is written into
+	svs.challenges right before the engine looks for it, so only real connect attempts
+	ever take a table entry.
+
+	Only clients the engine answers without authorization (LAN, sv_noauthorize) get
+	cookies, others still need the authorize server round trip and its table entry.
+
+	Writing an entry depends on the challenge_t layout, which is only verified for 1.0.
+	On 1.2 and 1.3 sv_challengeCookies has no effect until it is.
+*/
+#define CHALLENGE_COOKIE_WINDOW 10000 // ms, a cookie is valid for one to two windows
+
+#if COD_VERSION == COD2_1_0
+#define CHALLENGE_COOKIES 1
+#else
+#define CHALLENGE_COOKIES 0
+#endif
+
+#define CHALLENGE_SLOTS ( sizeof( svs.challenges ) / sizeof( svs.challenges[ 0 ] ) )
+
+static unsigned long long challengeCookieKey[ 2 ];
+static bool challengeCookieKeyed = false;
+
+#define SIPROUND \
+	do { \
+		v0 += v1; v1 = ( v1 << 13 ) | ( v1 >> 51 ); v1 ^= v0; v0 = ( v0 << 32 ) | ( v0 >> 32 ); \
+		v2 += v3; v3 = ( v3 << 16 ) | ( v3 >> 48 ); v3 ^= v2; \
+		v0 += v3; v3 = ( v3 << 21 ) | ( v3 >> 43 ); v3 ^= v0; \
+		v2 += v1; v1 = ( v1 << 17 ) | ( v1 >> 47 ); v1 ^= v2; v2 = ( v2 << 32 ) | ( v2 >> 32 ); \
+	} while ( 0 )
+
+static unsigned long long SVC_SipHash( const unsigned char *in, int length, const unsigned long long *key )
+{
+	unsigned long long v0 = 0x736f6d6570736575ULL ^ key[ 0 ];
+	unsigned long long v1 = 0x646f72616e646f6dULL ^ key[ 1 ];
+	unsigned long long v2 = 0x6c7967656e657261ULL ^ key[ 0 ];
+	unsigned long long v3 = 0x7465646279746573ULL ^ key[ 1 ];
+	unsigned long long m;
+	int i, blocks = length / 8;
+
+	for ( i = 0; i < blocks; i++ )
+	{
+		memcpy( &m, in + i * 8, 8 );
+
+		v3 ^= m;
+		SIPROUND;
+		SIPROUND;
+		v0 ^= m;
+	}
+
+	m = (unsigned long long)length << 56;
+
+	for ( i = blocks * 8; i < length; i++ )
+		m |= (unsigned long long)in[ i ] << ( 8 * ( i - blocks * 8 ) );
+
+	v3 ^= m;
+	SIPROUND;
+	SIPROUND;
+	v0 ^= m;
+
+	v2 ^= 0xff;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+	SIPROUND;
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static int SVC_ChallengeCookie( netadr_t from, int window )
+{
+	unsigned char in[ 10 ];
+
+	if ( !challengeCookieKeyed )
+	{
+		FILE *random = fopen( "/dev/urandom", "rb" );
+
+		if ( random == NULL || fread( challengeCookieKey, sizeof( challengeCookieKey ), 1, random ) != 1 )
+		{
+			challengeCookieKey[ 0 ] = ( (unsigned long long)time( NULL ) << 32 ) ^ getpid();
+			challengeCookieKey[ 1 ] = ( (unsigned long long)Sys_MilliSeconds() << 32 ) ^ (unsigned long long)cracking_rdtsc();
+		}
+
+		if ( random != NULL )
+			fclose( random );
+
+		challengeCookieKeyed = true;
+	}
+
+	memcpy( in, from.ip, 4 );
+	memcpy( in + 4, &from.port, 2 );
+	memcpy( in + 6, &window, 4 );
+
+	int cookie = (int)( SVC_SipHash( in, sizeof( in ), challengeCookieKey ) & 0x7FFFFFFF );
+
+	return cookie ? cookie : 1;
+}
+
+// Looks for a cookie in a connect packet and hands it to the engine's challenge table
+static void SVC_CheckChallengeCookie( netadr_t from, msg_t *msg )
+{
+	char packet[ 1400 ];
+	int length = msg->cursize - 4;
+
+	if ( length < 8 || memcmp( msg->data, "\xFF\xFF\xFF\xFF" "connect", 11 ) != 0 )
+		return;
+
+	if ( length > (int)sizeof( packet ) - 1 )
+		length = sizeof( packet ) - 1;
+
+	memcpy( packet, msg->data + 4, length );
+	packet[ length ] = '\0';
+
+	char *value = strstr( packet, "\\challenge\\" );
+
+	if ( value == NULL || !hook_isLanAddress( from ) )
+		return;
+
+	int challenge = atoi( value + strlen( "\\challenge\\" ) );
+	int window = Sys_MilliSeconds() / CHALLENGE_COOKIE_WINDOW;
+
+	if ( challenge != SVC_ChallengeCookie( from, window ) && challenge != SVC_ChallengeCookie( from, window - 1 ) )
+		return;
+
+	// Fixed slot per address, so cookie connects can not push out more than their share
+	challenge_t *entry = &svs.challenges[ SVC_HashForAddress( from, 32, 0 ) % CHALLENGE_SLOTS ];
+
+	memset( entry, 0, sizeof( challenge_t ) );
+	entry->adr = from;
+	entry->challenge = challenge;
+	entry->time = svs.time;
+	entry->pingTime = svs.time;
+	entry->firstTime = svs.time;
+}
+
+#endif
+
+#if COMPILE_RATELIMITER == 1 || COMPILE_BANS == 1
+// Installed when either module is compiled in, each check is guarded on its own
+cHook *hook_connectionless_packet;
+void hook_SV_ConnectionlessPacket(netadr_t from, msg_t *msg)
 {
-	// Prevent using getstatus as an amplifier
-	if ( SVC_RateLimitAddress( from, 10, 1000 ) )
+	HOOK_PROFILE(hook_SV_ConnectionlessPacket);
+
+#if COMPILE_RATELIMITER == 1
+	SVC_UpdateFloodMode();
+	SVC_UpdateBadSources();
+
+	// Repeat offenders go first, a few counter reads and no bucket or log line
+	if ( SVC_IsBadSource( from ) )
+	{
+		badSourceDropped++;
+		return;
+	}
+#endif
+
+#if COMPILE_BANS == 1
+	// Banned addresses are dropped before the engine or the buckets see them
+	if ( Ban_CheckConnectionless( from, msg ) != NULL )
 	{
-		Com_DPrintf( "SVC_Status: rate limit from %s exceeded, dropping request\n", NET_AdrToString( from ) );
+		bool connect = msg->cursize >= 11 && memcmp( msg->data, "\xFF\xFF\xFF\xFF" "connect", 11 ) == 0;
+
+		// Only connects get an answer, within the outbound budget when there is one
+#if COMPILE_RATELIMITER == 1
+		if ( connect && SVC_RateLimit( &outboundLeakyBucket, SVC_FloodBurst( sv_rateLimitOutboundBurst->floatval ), (int)sv_rateLimitOutboundPeriod->floatval ) )
+			connect = false;
+#endif
+
+		if ( connect )
+			NET_OutOfBandPrint( NS_SERVER, from, "error\nYou are banned from this server." );
+
 		return;
 	}
+#endif
+
+#if COMPILE_RATELIMITER == 1
+	if ( CHALLENGE_COOKIES && sv_challengeCookies->boolean )
+		SVC_CheckChallengeCookie( from, msg );
+#endif
+
+	void (*sig)(netadr_t from, msg_t *msg);
+	*(int *)&sig = hook_connectionless_packet->original();
+
+	sig(from, msg);
+
+	hook_connectionless_packet->rehook();
+}
+#endif
+
+#if COMPILE_RATELIMITER == 1
+void hook_SV_GetChallenge(netadr_t from)
+{
+	HOOK_PROFILE(hook_SV_GetChallenge);
 
-	// Allow getstatus to be DoSed relatively easily, but prevent
-	// excess outbound bandwidth usage when being flooded inbound
-	if ( SVC_RateLimit( &outboundLeakyBucket, 10, 100 ) )
+	if ( CHALLENGE_COOKIES && sv_challengeCookies->boolean && hook_isLanAddress( from ) )
 	{
-		Com_DPrintf( "SVC_Status: rate limit exceeded, dropping request\n" );
+		ratelimit_t *limit = &ratelimits[ RATELIMIT_CHALLENGE ];
+
+		// No per address bucket either, a spoofed flood allocates nothing
+		if ( SVC_RateLimit( &outboundLeakyBucket, SVC_FloodBurst( sv_rateLimitOutboundBurst->floatval ), (int)sv_rateLimitOutboundPeriod->floatval ) )
+		{
+			limit->dropped[ RATELIMIT_DROP_OUTBOUND ]++;
+			return;
+		}
+
+		limit->accepted++;
+		NET_OutOfBandPrint( NS_SERVER, from, "challengeResponse %i", SVC_ChallengeCookie( from, Sys_MilliSeconds() / CHALLENGE_COOKIE_WINDOW ) );
 		return;
 	}
 
-	SVC_Status(from);
+	// Prevent using getchallenge as an amplifier. Allow getchallenge to be DoSed relatively
+	// easily, but prevent excess outbound bandwidth usage when being flooded inbound
+	if ( SVC_RateLimitRequest( RATELIMIT_CHALLENGE, from, true ) )
+		return;
+
+	SV_GetChallenge(from);
+}
+
+void hook_SVC_Info(netadr_t from)
+{
+	HOOK_PROFILE(hook_SVC_Info);
+
+	// Prevent using getinfo as an amplifier. Allow getinfo to be DoSed relatively
+	// easily, but prevent excess outbound bandwidth usage when being flooded inbound
+	if ( SVC_RateLimitRequest( RATELIMIT_INFO, from, true ) )
+		return;
+
+	SVC_InfoCached(from);
+}
+
+void hook_SVC_Status(netadr_t from)
+{
+	HOOK_PROFILE(hook_SVC_Status);
+
+	// Prevent using getstatus as an amplifier. Allow getstatus to be DoSed relatively
+	// easily, but prevent excess outbound bandwidth usage when being flooded inbound
+	if ( SVC_RateLimitRequest( RATELIMIT_STATUS, from, true ) )
+		return;
+
+	SVC_StatusCached(from);
 }
 #endif
 
@@ -1265,6 +3590,8 @@ void manymaps_prepare(const char *mapname, int read)
 
 int hook_findMap(const char *qpath, void **buffer)
 {
+	HOOK_PROFILE(hook_findMap);
+
 	int read = FS_ReadFile(qpath, buffer);
 	manymaps_prepare(Cmd_Argv(1), read);
 
@@ -1276,6 +3603,8 @@ int hook_findMap(const char *qpath, void **buffer)
 
 bool hook_SV_MapExists(const char *mapname)
 {
+	HOOK_PROFILE(hook_SV_MapExists);
+
 	bool map_exists = SV_MapExists(mapname);
 
 	if (map_exists)
@@ -1394,6 +3723,13 @@ public:
 		cracking_hook_call(0x0809403E, (int)hook_SVC_Status);
 		cracking_hook_call(0x080940C4, (int)hook_SV_GetChallenge);
 		cracking_hook_call(0x08094191, (int)hook_SVC_RemoteCommand);
+		hook_queryCapture = new cHook((int)NET_OutOfBandPrint, (int)SVC_CaptureOutOfBandPrint);
+		hook_queryCapture->hook();
+#endif
+
+#if COMPILE_RATELIMITER == 1 || COMPILE_BANS == 1
+		hook_connectionless_packet = new cHook(0x08093F1E, (int)hook_SV_ConnectionlessPacket);
+		hook_connectionless_packet->hook();
 #endif
 
 #elif COD_VERSION == COD2_1_2
@@ -1466,6 +3802,13 @@ public:
 		cracking_hook_call(0x08095ADA, (int)hook_SVC_Status);
 		cracking_hook_call(0x08095BF8, (int)hook_SV_GetChallenge);
 		cracking_hook_call(0x08095D63, (int)hook_SVC_RemoteCommand);
+		hook_queryCapture = new cHook((int)NET_OutOfBandPrint, (int)SVC_CaptureOutOfBandPrint);
+		hook_queryCapture->hook();
+#endif
+
+#if COMPILE_RATELIMITER == 1 || COMPILE_BANS == 1
+		hook_connectionless_packet = new cHook(0x08095894, (int)hook_SV_ConnectionlessPacket);
+		hook_connectionless_packet->hook();
 #endif
 
 #elif COD_VERSION == COD2_1_3
@@ -1538,6 +3881,13 @@ public:
 		cracking_hook_call(0x08095B94, (int)hook_SVC_Status);
 		cracking_hook_call(0x08095CB2, (int)hook_SV_GetChallenge);
 		cracking_hook_call(0x08095E1D, (int)hook_SVC_RemoteCommand);
+		hook_queryCapture = new cHook((int)NET_OutOfBandPrint, (int)SVC_CaptureOutOfBandPrint);
+		hook_queryCapture->hook();
+#endif
+
+#if COMPILE_RATELIMITER == 1 || COMPILE_BANS == 1
+		hook_connectionless_packet = new cHook(0x0809594E, (int)hook_SV_ConnectionlessPacket);
+		hook_connectionless_packet->hook();
 #endif
 
 #endif